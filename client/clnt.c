@@ -8,6 +8,9 @@
 #include <pthread.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include "../common/frame.h"
+#include "../common/proto.h"
+#include "../common/trace.h"
 
 // MESSAGE BUFFER, SOCKET BUFFER, USER NAME INPUT
 #define ST_SIZE 12
@@ -42,6 +45,7 @@
 // 사용자의 정보
 struct Player
 {
+    unsigned int id; // 플레이어 ID (접속하면 서버가 정해줌)
     char name[NAME_SIZE];
     char difficulty[50];
     bool is_ready;
@@ -105,6 +109,7 @@ void main()
     pthread_t mapping_thr;     // 맵핑 스레드
     pthread_t kb_handling_thr; // 키보드 입력 제어 스레드
     void *thread_return;
+    char login[sizeof(struct proto_login) + PROTO_NAME_MAX]; // 이름 등록 요청
 
     // 접속 UI
     start_ui();
@@ -124,6 +129,9 @@ void main()
         error_handling("connect() error");
     }
 
+    // 이름 등록 (같은 이름이 접속 중이면 서버가 거절함)
+    frame_send(sock, FT_LOGIN, login, proto_login_enc(login, user.name));
+
     pthread_create(&recv_thr, NULL, recv_msg, (void *)&sock);
     pthread_create(&mapping_thr, NULL, mapping, (void *)&sock);
     pthread_create(&kb_handling_thr, NULL, kb_handling, (void *)&sock);
@@ -211,34 +219,65 @@ void *recv_msg(void *arg)
     srand(time(NULL));
 
     int sock = *((int *)arg);
-    char recv_buf[ST_SIZE + NAME_SIZE + BUF_SIZE]; // 수신 메세지 원본
-    char buf_copy[ST_SIZE + NAME_SIZE + BUF_SIZE]; // 수신 메세지 복사본
-    char *tmp;
 
+    struct frame_ring ring;     // 수신 링 버퍼
+    struct frame f;             // 꺼낸 프레임
+    struct proto_ready *ready;  // 페이로드를 그대로 가리킴
+    struct proto_result *result;
+    struct proto_busy *busy;
+    struct proto_hello *hello;
+    struct proto_login_ack *ack;
     int str_len;
+    int ret;
 
     // 초기화
-    memset(buf_copy, 0, sizeof(buf_copy));
-    memset(recv_buf, 0, sizeof(recv_buf));
+    if (frame_ring_init(&ring, RING_INIT) == -1)
+    {
+        return (void *)-1;
+    }
 
     while (1)
     {
-        // 메시지 읽어오기
-        read(sock, recv_buf, ST_SIZE + NAME_SIZE + BUF_SIZE - 1);
+        // 메시지 읽어오기 (한 번에 여러 프레임이 올 수 있음)
+        str_len = frame_ring_read(&ring, sock);
 
-        if (str_len == -1)
+        if (str_len <= 0)
         {
             return (void *)-1;
         }
-        else
+        TRACE1(clnt, recv, str_len);
+
+        while ((ret = frame_ring_next(&ring, &f)) == 1)
         {
-            tmp = strtok(recv_buf, " ");
+            TRACE2(clnt, frame, f.type, f.len);
+
+            if (f.type == FT_HELLO)
+            {
+                // 서버가 정해준 세션 ID, 상대 메시지에는 상대의 ID가 찍혀서 옴
+                hello = proto_hello_dec(f.data, f.len);
 
-            if (!strcmp(tmp, "READY"))
+                if (hello != NULL)
+                {
+                    user.id = proto32(hello->session);
+                }
+            }
+            else if (f.type == FT_LOGIN)
             {
-                tmp = strtok(NULL, " ");
+                // 이름 등록 결과
+                ack = proto_login_ack_dec(f.data, f.len);
 
-                if (strcmp(tmp, user.name))
+                if (ack != NULL && !ack->ok)
+                {
+                    endwin();
+                    printf("Name '%s' is already in use\n", user.name);
+                    exit(1);
+                }
+            }
+            else if (f.type == FT_READY)
+            {
+                ready = proto_ready_dec(f.data, f.len);
+
+                if (ready != NULL && proto32(ready->hdr.player) != user.id)
                 {
                     // 대결 상대 정보 초기화
                     memset(rival_user.name, 0, sizeof(rival_user.name));
@@ -247,23 +286,21 @@ void *recv_msg(void *arg)
                     rival_user.score = 0;
 
                     // 대결 상대 정보 입력
-                    strcpy(rival_user.name, tmp);
-                    tmp = strtok(NULL, " ");
-                    strcpy(rival_user.difficulty, tmp);
-                    tmp = strtok(NULL, " ");
-                    rival_user.is_ready = atoi(tmp);
-                    tmp = strtok(NULL, " ");
-                    rival_user.score = atoi(tmp);
+                    rival_user.id = proto32(ready->hdr.player);
+                    memcpy(rival_user.name, ready->name, ready->name_len);
+                    strcpy(rival_user.difficulty, proto_diff_name(ready->difficulty));
+                    rival_user.is_ready = ready->ready;
+                    rival_user.score = proto16(ready->score);
+                    TRACE2(clnt, apply, f.type, rival_user.id);
                 }
             }
-            else if (!strcmp(tmp, "RESULT"))
+            else if (f.type == FT_RESULT)
             {
-                tmp = strtok(NULL, " ");
+                result = proto_result_dec(f.data, f.len);
 
-                if (strcmp(tmp, user.name))
+                if (result != NULL && proto32(result->hdr.player) != user.id)
                 {
-                    tmp = strtok(NULL, " ");
-                    rival_user.score = atol(tmp);
+                    rival_user.score = proto16(result->score);
 
                     if (user.score <= rival_user.score)
                     {
@@ -274,10 +311,28 @@ void *recv_msg(void *arg)
                         user.my_win = false;
                     }
 
-                    tmp = strtok(NULL, " ");
                     rival_user.is_end = true;
+                    TRACE2(clnt, apply, f.type, proto32(result->hdr.player));
                 }
             }
+            else if (f.type == FT_PING)
+            {
+                // 서버 하트비트에 응답
+                frame_send(sock, FT_PONG, NULL, 0);
+            }
+            else if (f.type == FT_BUSY)
+            {
+                // 서버가 과부하로 접속을 거절함
+                busy = proto_busy_dec(f.data, f.len);
+                endwin();
+                printf("Server is busy, retry in %u ms\n", busy != NULL ? proto32(busy->retry_ms) : 1000);
+                exit(1);
+            }
+        }
+
+        if (ret == -1)
+        {
+            return (void *)-1;
         }
     }
 }
@@ -288,6 +343,7 @@ void *kb_handling(void *arg)
     int sock = *((int *)arg);
 
     char msg[ST_SIZE + NAME_SIZE + BUF_SIZE]; // 송신할 메세지 내용
+    int msg_len;
     memset(msg, 0, sizeof(msg));
 
     while (1)
@@ -345,8 +401,8 @@ void *kb_handling(void *arg)
             case 'y':
                 user.is_ready = true;
 
-                sprintf(msg, "READY %s %s %d %d", user.name, user.difficulty, user.is_ready, user.score);
-                write(sock, msg, strlen(msg));
+                msg_len = proto_ready_enc(msg, user.id, proto_diff_parse(user.difficulty), user.is_ready, user.score, user.name);
+                frame_send(sock, FT_READY, msg, msg_len);
                 memset(msg, 0, sizeof(msg));
 
                 if (user.is_ready == true & rival_user.is_ready == true)
@@ -415,8 +471,18 @@ void *kb_handling(void *arg)
             {
                 user.is_end = true;
 
-                sprintf(msg, "RESULT %s %d %d", user.name, user.score, user.is_end);
-                write(sock, msg, strlen(msg));
+                // 상대를 알면 상대에게만 보냄
+                if (rival_user.id != 0)
+                {
+                    msg_len = proto_direct_enc(msg, FT_RESULT, &rival_user.id, 1);
+                    msg_len += proto_result_enc(msg + msg_len, user.id, user.score, user.is_end);
+                    frame_send(sock, FT_DIRECT, msg, msg_len);
+                }
+                else
+                {
+                    msg_len = proto_result_enc(msg, user.id, user.score, user.is_end);
+                    frame_send(sock, FT_RESULT, msg, msg_len);
+                }
                 memset(msg, 0, sizeof(msg));
 
                 q_count = 0;
@@ -513,6 +579,8 @@ void start_ui()
     mvwgetstr(connect_window, 8, 2, my_name);
 
     // 본인 정보 초기화
+    srand(time(NULL) ^ getpid());
+    user.id = 0;    // 접속하면 서버가 FT_HELLO로 세션 ID를 알려줌
     strcpy(user.name, my_name);
     memset(user.difficulty, 0, sizeof(user.difficulty));
     user.is_ready = false;
@@ -0,0 +1,276 @@
+#ifdef __linux__
+#define _GNU_SOURCE
+#endif
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/uio.h>
+#include "frame.h"
+
+static char *ring_map(unsigned cap, int *mirror);
+static void ring_unmap(char *buf, unsigned cap, int mirror);
+static int ring_reserve(struct frame_ring *r, unsigned need);
+
+//헤더를 out에 쓰고 길이를 반환 (out은 FRAME_HDR_MAX 이상)
+int frame_hdr(char *out, int type, unsigned len) {
+        int n = 0;
+
+        while(len >= 0x80) {
+                out[n++] = (char)(len | 0x80);
+                len >>= 7;
+        }
+        out[n++] = (char)len;
+        out[n++] = (char)type;
+        return n;
+}
+
+//p에서 프레임 하나를 해석
+//완전한 프레임이면 프레임 전체 길이, 아직 덜 왔으면 0, 잘못된 프레임이면 -1
+//덜 왔을 때도 길이를 알면 f->raw_len에 필요한 전체 길이를 넣어줌
+int frame_parse(char *p, unsigned avail, struct frame *f) {
+        unsigned len = 0, i = 0, shift = 0;
+        unsigned char b;
+
+        f->raw_len = 0;
+        while(1) {
+                if(i >= avail) {
+                        return 0;
+                }
+                b = (unsigned char)p[i++];
+                len |= (unsigned)(b & 0x7f) << shift;
+                if(!(b & 0x80)) {
+                        break;
+                }
+                shift += 7;
+                if(shift >= 28) {
+                        return -1;
+                }
+        }
+        if(len > FRAME_MAX) {
+                return -1;
+        }
+        f->raw_len = i + 1 + len;
+        if(f->raw_len > avail) {
+                return 0;
+        }
+
+        f->type = (unsigned char)p[i];
+        f->data = p + i + 1;
+        f->len = len;
+        f->raw = p;
+        return f->raw_len;
+}
+
+int frame_ring_init(struct frame_ring *r, unsigned cap) {
+        r->buf = ring_map(cap, &r->mirror);
+        if(r->buf == NULL) {
+                return -1;
+        }
+        r->cap = cap;
+        r->head = r->tail = 0;
+        return 0;
+}
+
+void frame_ring_free(struct frame_ring *r) {
+        if(r->buf != NULL) {
+                ring_unmap(r->buf, r->cap, r->mirror);
+        }
+        r->buf = NULL;
+}
+
+void frame_ring_reset(struct frame_ring *r) {
+        r->head = r->tail = 0;
+}
+
+//바로 채울 수 있는 연속된 빈 공간, 채운 만큼 frame_ring_commit (공간을 만들 수 없으면 NULL)
+char *frame_ring_space(struct frame_ring *r, unsigned *room) {
+        unsigned pos;
+
+        if(ring_reserve(r, 1) == -1) {
+                return NULL;
+        }
+        pos = r->tail % r->cap;
+        *room = r->cap - (r->tail - r->head);
+        //이중 매핑이 아니면 끝까지만 (ring_reserve가 앞으로 당겨둠)
+        if(!r->mirror && *room > r->cap - pos) {
+                *room = r->cap - pos;
+        }
+        return r->buf + pos;
+}
+
+void frame_ring_commit(struct frame_ring *r, unsigned n) {
+        r->tail += n;
+}
+
+//빈 공간에 바로 read, 링을 비울 때까지는 읽은 프레임을 꺼내야 함
+ssize_t frame_ring_read(struct frame_ring *r, int fd) {
+        unsigned room;
+        char *p;
+        ssize_t n;
+
+        p = frame_ring_space(r, &room);
+        if(p == NULL) {
+                errno = ENOMEM;
+                return -1;
+        }
+        n = read(fd, p, room);
+        if(n > 0) {
+                frame_ring_commit(r, n);
+        }
+        return n;
+}
+
+//이미 받은 데이터를 링에 덧붙임 (io_uring 제공 버퍼 등)
+int frame_ring_write(struct frame_ring *r, char *data, unsigned len) {
+        unsigned pos;
+
+        if(ring_reserve(r, len) == -1) {
+                return -1;
+        }
+        pos = r->tail % r->cap;
+        memcpy(r->buf + pos, data, len);
+        r->tail += len;
+        return 0;
+}
+
+//다음 프레임을 꺼냄, 1이면 f에 프레임, 0이면 더 받아야 함, -1이면 잘못된 프레임
+//f가 가리키는 메모리는 다음 frame_ring_read/write 전까지만 유효
+int frame_ring_next(struct frame_ring *r, struct frame *f) {
+        unsigned used = r->tail - r->head;
+        int n;
+
+        if(used == 0) {
+                return 0;
+        }
+        n = frame_parse(r->buf + r->head % r->cap, used, f);
+        if(n == -1) {
+                return -1;
+        }
+        if(n == 0) {
+                //링보다 큰 프레임이 오고 있으면 미리 키워둠
+                if(f->raw_len > r->cap && ring_reserve(r, f->raw_len - used) == -1) {
+                        return -1;
+                }
+                return 0;
+        }
+        r->head += n;
+        if(r->head == r->tail) {
+                r->head = r->tail = 0;
+        }
+        return 1;
+}
+
+//헤더와 페이로드를 모두 보낼 때까지 writev (블로킹 소켓용)
+//한 번의 시스템 콜로 보내서 여러 스레드가 같은 소켓에 보내도 프레임이 섞이지 않게 함
+int frame_send(int fd, int type, char *data, unsigned len) {
+        char hdr[FRAME_HDR_MAX];
+        struct iovec iov[2];
+        ssize_t n;
+        int i = 0;
+
+        iov[0].iov_base = hdr;
+        iov[0].iov_len = frame_hdr(hdr, type, len);
+        iov[1].iov_base = data;
+        iov[1].iov_len = len;
+        while(i < 2) {
+                n = writev(fd, iov + i, 2 - i);
+                if(n == -1 && errno == EINTR) {
+                        continue;
+                }
+                if(n <= 0) {
+                        return -1;
+                }
+                //일부만 보냈으면 나머지부터 다시
+                for( ; i < 2 && (size_t)n >= iov[i].iov_len ; i++) {
+                        n -= iov[i].iov_len;
+                }
+                if(i < 2) {
+                        iov[i].iov_base = (char *)iov[i].iov_base + n;
+                        iov[i].iov_len -= n;
+                }
+        }
+        return 0;
+}
+
+//len바이트를 더 넣을 수 있게 공간 확보, 모자라면 두 배씩 키움
+static int ring_reserve(struct frame_ring *r, unsigned need) {
+        unsigned used = r->tail - r->head, cap = r->cap, pos;
+        char *buf;
+        int mirror;
+
+        if(!r->mirror) {
+                pos = r->head % r->cap;
+                //끝에 남은 공간이 모자라면 남은 데이터를 앞으로 당김
+                if(pos + used + need > r->cap && used + need <= r->cap) {
+                        memmove(r->buf, r->buf + pos, used);
+                        r->head = 0;
+                        r->tail = used;
+                }
+        }
+        if(used + need <= r->cap) {
+                return 0;
+        }
+
+        while(used + need > cap) {
+                cap *= 2;
+        }
+        if(cap > FRAME_MAX * 2) {
+                return -1;
+        }
+        buf = ring_map(cap, &mirror);
+        if(buf == NULL) {
+                return -1;
+        }
+        //이중 매핑이면 감긴 데이터도 연속으로 복사됨
+        memcpy(buf, r->buf + r->head % r->cap, used);
+        ring_unmap(r->buf, r->cap, r->mirror);
+        r->buf = buf;
+        r->cap = cap;
+        r->mirror = mirror;
+        r->head = 0;
+        r->tail = used;
+        return 0;
+}
+
+#ifdef __linux__
+//[0, cap)과 [cap, 2cap)이 같은 페이지를 가리키도록 매핑
+//공유 익명 매핑을 old_size 0으로 mremap하면 같은 페이지의 두 번째 매핑이 생김
+static char *ring_map(unsigned cap, int *mirror) {
+        char *base, *buf;
+
+        *mirror = 0;
+        base = mmap(NULL, (size_t)cap * 2, PROT_NONE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(base == MAP_FAILED) {
+                return malloc(cap);
+        }
+        buf = mmap(base, cap, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
+        if(buf == MAP_FAILED ||
+           mremap(buf, 0, cap, MREMAP_MAYMOVE | MREMAP_FIXED, base + cap) == MAP_FAILED) {
+                //매핑 수 제한 등으로 실패하면 일반 버퍼로
+                munmap(base, (size_t)cap * 2);
+                return malloc(cap);
+        }
+        *mirror = 1;
+        return buf;
+}
+
+static void ring_unmap(char *buf, unsigned cap, int mirror) {
+        if(mirror) {
+                munmap(buf, (size_t)cap * 2);
+        } else {
+                free(buf);
+        }
+}
+#else
+//이중 매핑을 못 하면 일반 버퍼, 감기기 전에 앞으로 당겨서 사용
+static char *ring_map(unsigned cap, int *mirror) {
+        *mirror = 0;
+        return malloc(cap);
+}
+
+static void ring_unmap(char *buf, unsigned cap, int mirror) {
+        free(buf);
+}
+#endif
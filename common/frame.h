@@ -0,0 +1,56 @@
+#ifndef FRAME_H
+#define FRAME_H
+
+#include <sys/types.h>
+
+//프레임 = [페이로드 길이 varint][타입 1바이트][페이로드]
+//서버와 클라이언트가 같이 사용
+
+#define FRAME_MAX (1 << 20)     //페이로드 최대 크기
+#define FRAME_HDR_MAX 6         //varint 최대 5바이트 + 타입
+#define RING_INIT 4096          //수신 링 초기 크기 (페이지 크기의 배수)
+
+//프레임 타입
+#define FT_TEXT 0
+#define FT_READY 1
+#define FT_RESULT 2
+#define FT_PING 3               //하트비트 요청, 받은 쪽은 FT_PONG으로 응답 (서버가 전달하지 않음)
+#define FT_PONG 4
+#define FT_BUSY 5               //서버가 새 연결을 받지 않음 (서버 -> 클라이언트, 보낸 뒤 연결 종료)
+#define FT_SHM 6                //UNIX 소켓 클라이언트의 공유 메모리 전환 요청/응답 (common/shm.h)
+#define FT_HELLO 7              //접속 직후 서버가 정해준 세션 ID (서버 -> 클라이언트)
+#define FT_LOGIN 8              //이름 등록 요청/응답, 같은 이름은 한 명만 쓸 수 있음
+#define FT_DIRECT 9             //지정한 세션 ID들에게만 전달 (클라이언트 -> 서버)
+
+struct frame {
+        int type;
+        char *data;             //페이로드, 링 안을 그대로 가리킴 (다음 read 전까지 유효)
+        unsigned len;
+        char *raw;              //헤더를 포함한 프레임 전체
+        unsigned raw_len;
+};
+
+//수신 링 버퍼
+//리눅스에서는 같은 메모리를 두 번 연달아 매핑해서 끝에서 감긴 프레임도 연속된 메모리로 보임
+struct frame_ring {
+        char *buf;
+        unsigned cap;
+        unsigned head, tail;    //계속 증가하는 값, 위치는 % cap
+        int mirror;             //이중 매핑 여부 (아니면 앞으로 당겨서 사용)
+};
+
+int frame_hdr(char *out, int type, unsigned len);
+int frame_parse(char *p, unsigned avail, struct frame *f);
+
+int frame_ring_init(struct frame_ring *r, unsigned cap);
+void frame_ring_free(struct frame_ring *r);
+void frame_ring_reset(struct frame_ring *r);
+char *frame_ring_space(struct frame_ring *r, unsigned *room);
+void frame_ring_commit(struct frame_ring *r, unsigned n);
+ssize_t frame_ring_read(struct frame_ring *r, int fd);
+int frame_ring_write(struct frame_ring *r, char *data, unsigned len);
+int frame_ring_next(struct frame_ring *r, struct frame *f);
+
+int frame_send(int fd, int type, char *data, unsigned len);
+
+#endif
@@ -0,0 +1,212 @@
+#include <string.h>
+#include "frame.h"
+#include "proto.h"
+
+static char *diff_names[] = { "NONE", "BEGINNER", "INTERMEDIATE", "EXPERT" };
+
+static void hdr_enc(struct proto_hdr *h, uint32_t player) {
+        h->version = PROTO_VERSION;
+        h->flags = 0;
+        h->player = proto32(player);
+}
+
+//out은 PROTO_READY_MAX 이상, 페이로드 길이를 반환
+int proto_ready_enc(char *out, uint32_t player, int difficulty, int ready, int score, char *name) {
+        struct proto_ready *m = (struct proto_ready *)out;
+        int name_len = strlen(name);
+
+        if(name_len > PROTO_NAME_MAX) {
+                name_len = PROTO_NAME_MAX;
+        }
+        hdr_enc(&m->hdr, player);
+        m->difficulty = difficulty;
+        m->ready = ready;
+        m->score = proto16((uint16_t)score);
+        m->name_len = name_len;
+        memcpy(m->name, name, name_len);
+        return sizeof(*m) + name_len;
+}
+
+int proto_result_enc(char *out, uint32_t player, int score, int end) {
+        struct proto_result *m = (struct proto_result *)out;
+
+        hdr_enc(&m->hdr, player);
+        m->score = proto16((uint16_t)score);
+        m->end = end;
+        return sizeof(*m);
+}
+
+int proto_busy_enc(char *out, int reason, uint32_t retry_ms) {
+        struct proto_busy *m = (struct proto_busy *)out;
+
+        m->version = PROTO_VERSION;
+        m->reason = reason;
+        m->retry_ms = proto32(retry_ms);
+        return sizeof(*m);
+}
+
+int proto_shm_enc(char *out, int ok, uint32_t ring_size) {
+        struct proto_shm *m = (struct proto_shm *)out;
+
+        m->version = PROTO_VERSION;
+        m->ok = ok;
+        m->ring_size = proto32(ring_size);
+        return sizeof(*m);
+}
+
+int proto_hello_enc(char *out, uint32_t session) {
+        struct proto_hello *m = (struct proto_hello *)out;
+
+        m->version = PROTO_VERSION;
+        m->session = proto32(session);
+        return sizeof(*m);
+}
+
+//out은 sizeof(struct proto_login) + PROTO_NAME_MAX 이상
+int proto_login_enc(char *out, char *name) {
+        struct proto_login *m = (struct proto_login *)out;
+        int name_len = strlen(name);
+
+        if(name_len > PROTO_NAME_MAX) {
+                name_len = PROTO_NAME_MAX;
+        }
+        m->version = PROTO_VERSION;
+        m->name_len = name_len;
+        memcpy(m->name, name, name_len);
+        return sizeof(*m) + name_len;
+}
+
+int proto_login_ack_enc(char *out, int ok, uint32_t session) {
+        struct proto_login_ack *m = (struct proto_login_ack *)out;
+
+        m->version = PROTO_VERSION;
+        m->ok = ok;
+        m->session = proto32(session);
+        return sizeof(*m);
+}
+
+//헤더만 씀, 전달할 페이로드는 호출한 쪽이 반환값 위치부터 이어서 씀
+int proto_direct_enc(char *out, int type, uint32_t *to, int n_to) {
+        struct proto_direct *m = (struct proto_direct *)out;
+        int i;
+
+        m->version = PROTO_VERSION;
+        m->type = type;
+        m->n_to = n_to;
+        for(i = 0 ; i < n_to ; i++) {
+                m->to[i] = proto32(to[i]);
+        }
+        return sizeof(*m) + sizeof(uint32_t) * n_to;
+}
+
+//버전이나 길이가 맞지 않으면 NULL
+struct proto_ready *proto_ready_dec(char *p, unsigned len) {
+        struct proto_ready *m = (struct proto_ready *)p;
+
+        if(len < sizeof(*m) || m->hdr.version != PROTO_VERSION) {
+                return NULL;
+        }
+        if(m->name_len > PROTO_NAME_MAX || len != sizeof(*m) + m->name_len) {
+                return NULL;
+        }
+        return m;
+}
+
+struct proto_result *proto_result_dec(char *p, unsigned len) {
+        struct proto_result *m = (struct proto_result *)p;
+
+        if(len != sizeof(*m) || m->hdr.version != PROTO_VERSION) {
+                return NULL;
+        }
+        return m;
+}
+
+struct proto_busy *proto_busy_dec(char *p, unsigned len) {
+        struct proto_busy *m = (struct proto_busy *)p;
+
+        if(len != sizeof(*m) || m->version != PROTO_VERSION) {
+                return NULL;
+        }
+        return m;
+}
+
+struct proto_shm *proto_shm_dec(char *p, unsigned len) {
+        struct proto_shm *m = (struct proto_shm *)p;
+
+        if(len != sizeof(*m) || m->version != PROTO_VERSION) {
+                return NULL;
+        }
+        return m;
+}
+
+struct proto_hello *proto_hello_dec(char *p, unsigned len) {
+        struct proto_hello *m = (struct proto_hello *)p;
+
+        if(len != sizeof(*m) || m->version != PROTO_VERSION) {
+                return NULL;
+        }
+        return m;
+}
+
+struct proto_login *proto_login_dec(char *p, unsigned len) {
+        struct proto_login *m = (struct proto_login *)p;
+
+        if(len < sizeof(*m) || m->version != PROTO_VERSION) {
+                return NULL;
+        }
+        if(m->name_len == 0 || m->name_len > PROTO_NAME_MAX || len != sizeof(*m) + m->name_len) {
+                return NULL;
+        }
+        return m;
+}
+
+struct proto_login_ack *proto_login_ack_dec(char *p, unsigned len) {
+        struct proto_login_ack *m = (struct proto_login_ack *)p;
+
+        if(len != sizeof(*m) || m->version != PROTO_VERSION) {
+                return NULL;
+        }
+        return m;
+}
+
+//페이로드는 sizeof(*m) + 4 * n_to부터
+struct proto_direct *proto_direct_dec(char *p, unsigned len) {
+        struct proto_direct *m = (struct proto_direct *)p;
+
+        if(len < sizeof(*m) || m->version != PROTO_VERSION) {
+                return NULL;
+        }
+        if(m->n_to == 0 || m->n_to > PROTO_DIRECT_MAX || len < sizeof(*m) + sizeof(uint32_t) * m->n_to) {
+                return NULL;
+        }
+        return m;
+}
+
+//READY/RESULT 페이로드의 플레이어 ID를 덮어씀 (서버가 중계하기 전에), 헤더가 있는 타입이 아니면 -1
+int proto_stamp(int type, char *p, unsigned len, uint32_t player) {
+        struct proto_hdr *h = (struct proto_hdr *)p;
+
+        if((type != FT_READY && type != FT_RESULT) || len < sizeof(*h) || h->version != PROTO_VERSION) {
+                return -1;
+        }
+        h->player = proto32(player);
+        return 0;
+}
+
+int proto_diff_parse(char *name) {
+        int i;
+
+        for(i = DIFF_BEGINNER ; i <= DIFF_EXPERT ; i++) {
+                if(!strcmp(name, diff_names[i])) {
+                        return i;
+                }
+        }
+        return DIFF_NONE;
+}
+
+char *proto_diff_name(int difficulty) {
+        if(difficulty < DIFF_NONE || difficulty > DIFF_EXPERT) {
+                difficulty = DIFF_NONE;
+        }
+        return diff_names[difficulty];
+}
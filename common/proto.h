@@ -0,0 +1,123 @@
+#ifndef PROTO_H
+#define PROTO_H
+
+#include <stdint.h>
+
+//게임 메시지 바이너리 형식 (프레임 페이로드)
+//모든 정수는 리틀 엔디언, 구조체는 패딩 없이 그대로 전송
+//수신 측은 길이와 버전만 확인하고 페이로드를 구조체로 바로 읽음 (복사 없음)
+
+#define PROTO_VERSION 1
+#define PROTO_NAME_MAX 19       //이름 최대 길이 (NUL 제외)
+
+//난이도
+#define DIFF_NONE 0
+#define DIFF_BEGINNER 1
+#define DIFF_INTERMEDIATE 2
+#define DIFF_EXPERT 3
+
+//공통 헤더
+struct proto_hdr {
+        uint8_t version;
+        uint8_t flags;
+        uint32_t player;        //플레이어 ID, 서버가 보낸 연결의 세션 ID로 덮어씀
+} __attribute__((packed));
+
+//READY (FT_READY), 이름은 name_len바이트만 보냄
+struct proto_ready {
+        struct proto_hdr hdr;
+        uint8_t difficulty;
+        uint8_t ready;
+        uint16_t score;
+        uint8_t name_len;
+        char name[];
+} __attribute__((packed));
+
+//RESULT (FT_RESULT)
+struct proto_result {
+        struct proto_hdr hdr;
+        uint16_t score;
+        uint8_t end;
+} __attribute__((packed));
+
+//BUSY (FT_BUSY), 서버가 과부하로 접속을 거절
+#define BUSY_FULL 0             //연결 수 한계
+#define BUSY_RATE 1             //새 접속 속도 한계
+
+struct proto_busy {
+        uint8_t version;
+        uint8_t reason;
+        uint32_t retry_ms;      //이 시간 뒤에 다시 접속
+} __attribute__((packed));
+
+//SHM (FT_SHM) 응답, ok면 memfd, 서버 eventfd, 클라이언트 eventfd를 SCM_RIGHTS로 같이 보냄
+struct proto_shm {
+        uint8_t version;
+        uint8_t ok;
+        uint32_t ring_size;     //방향별 링 크기
+} __attribute__((packed));
+
+//HELLO (FT_HELLO), 다른 플레이어의 메시지에는 이 ID가 찍혀서 옴
+struct proto_hello {
+        uint8_t version;
+        uint32_t session;
+} __attribute__((packed));
+
+//LOGIN (FT_LOGIN) 요청, 이름은 name_len바이트만 보냄
+struct proto_login {
+        uint8_t version;
+        uint8_t name_len;
+        char name[];
+} __attribute__((packed));
+
+//LOGIN 응답, 이미 다른 연결이 쓰는 이름이면 ok = 0
+struct proto_login_ack {
+        uint8_t version;
+        uint8_t ok;
+        uint32_t session;
+} __attribute__((packed));
+
+//DIRECT (FT_DIRECT), 대상 n_to개 뒤에 type 프레임의 페이로드가 이어짐
+//서버는 type 프레임으로 바꿔서 대상에게만 보냄 (READY/RESULT면 플레이어 ID를 찍음)
+#define PROTO_DIRECT_MAX 16     //대상 최대 수
+
+struct proto_direct {
+        uint8_t version;
+        uint8_t type;           //전달할 프레임 타입 (FT_TEXT, FT_READY, FT_RESULT)
+        uint8_t n_to;
+        uint32_t to[];
+} __attribute__((packed));
+
+#define PROTO_READY_MAX (sizeof(struct proto_ready) + PROTO_NAME_MAX)
+
+//전송 순서 <-> 호스트 순서 (리틀 엔디언 호스트에서는 그대로)
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+#define proto16(v) __builtin_bswap16(v)
+#define proto32(v) __builtin_bswap32(v)
+#else
+#define proto16(v) (v)
+#define proto32(v) (v)
+#endif
+
+int proto_ready_enc(char *out, uint32_t player, int difficulty, int ready, int score, char *name);
+int proto_result_enc(char *out, uint32_t player, int score, int end);
+int proto_busy_enc(char *out, int reason, uint32_t retry_ms);
+int proto_shm_enc(char *out, int ok, uint32_t ring_size);
+int proto_hello_enc(char *out, uint32_t session);
+int proto_login_enc(char *out, char *name);
+int proto_login_ack_enc(char *out, int ok, uint32_t session);
+int proto_direct_enc(char *out, int type, uint32_t *to, int n_to);
+struct proto_ready *proto_ready_dec(char *p, unsigned len);
+struct proto_result *proto_result_dec(char *p, unsigned len);
+struct proto_busy *proto_busy_dec(char *p, unsigned len);
+struct proto_shm *proto_shm_dec(char *p, unsigned len);
+struct proto_hello *proto_hello_dec(char *p, unsigned len);
+struct proto_login *proto_login_dec(char *p, unsigned len);
+struct proto_login_ack *proto_login_ack_dec(char *p, unsigned len);
+struct proto_direct *proto_direct_dec(char *p, unsigned len);
+int proto_stamp(int type, char *p, unsigned len, uint32_t player);
+
+int proto_diff_parse(char *name);
+char *proto_diff_name(int difficulty);
+
+#endif
@@ -0,0 +1,192 @@
+#define _GNU_SOURCE
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include "shm.h"
+
+#define RING_MASK (SHM_RING_SIZE - 1)
+
+static void wake(int fd) {
+        uint64_t one = 1;
+
+        write(fd, &one, sizeof(one));
+}
+
+//서버 쪽 : 링 2개를 담은 memfd와 eventfd 2개를 만듦 (처음에는 양쪽 다 잠든 상태)
+int shm_create(int *memfd, int *srv_fd, int *clnt_fd) {
+        struct shm_area *a;
+
+        *memfd = memfd_create("serv-shm", MFD_CLOEXEC);
+        if(*memfd == -1) {
+                return -1;
+        }
+        if(ftruncate(*memfd, sizeof(struct shm_area)) == -1) {
+                close(*memfd);
+                return -1;
+        }
+        a = mmap(NULL, sizeof(*a), PROT_READ | PROT_WRITE, MAP_SHARED, *memfd, 0);
+        if(a == MAP_FAILED) {
+                close(*memfd);
+                return -1;
+        }
+        a->c2s.reader_wait = a->s2c.reader_wait = 1;
+        munmap(a, sizeof(*a));
+
+        *srv_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        *clnt_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(*srv_fd == -1 || *clnt_fd == -1) {
+                if(*srv_fd != -1) {
+                        close(*srv_fd);
+                }
+                if(*clnt_fd != -1) {
+                        close(*clnt_fd);
+                }
+                close(*memfd);
+                return -1;
+        }
+        return 0;
+}
+
+//memfd를 매핑하고 eventfd를 넘겨받음 (memfd는 닫아도 됨, eventfd는 shm_detach에서 닫힘)
+int shm_attach(struct shm_end *e, int memfd, int srv_fd, int clnt_fd, int side) {
+        e->area = mmap(NULL, sizeof(struct shm_area), PROT_READ | PROT_WRITE, MAP_SHARED, memfd, 0);
+        if(e->area == MAP_FAILED) {
+                e->area = NULL;
+                return -1;
+        }
+        if(side == SHM_SERVER) {
+                e->in = &e->area->c2s;
+                e->out = &e->area->s2c;
+                e->wake_fd = srv_fd;
+                e->peer_fd = clnt_fd;
+        } else {
+                e->in = &e->area->s2c;
+                e->out = &e->area->c2s;
+                e->wake_fd = clnt_fd;
+                e->peer_fd = srv_fd;
+        }
+        return 0;
+}
+
+void shm_detach(struct shm_end *e) {
+        if(e->area != NULL) {
+                munmap(e->area, sizeof(struct shm_area));
+                e->area = NULL;
+        }
+        close(e->wake_fd);
+        close(e->peer_fd);
+}
+
+//받은 데이터를 len바이트까지 꺼냄, 비어 있으면 0
+//링은 상대도 쓸 수 있는 메모리이므로 인덱스가 링 크기를 넘으면 -1 (EPROTO, 연결을 끊어야 함)
+ssize_t shm_read(struct shm_end *e, char *buf, unsigned len) {
+        struct shm_ring *r = e->in;
+        uint32_t head = __atomic_load_n(&r->head, __ATOMIC_RELAXED);
+        uint32_t n = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) - head;
+        uint32_t pos = head & RING_MASK, first;
+
+        if(n > SHM_RING_SIZE) {
+                errno = EPROTO;
+                return -1;
+        }
+        if(len > SHM_RING_SIZE) {
+                len = SHM_RING_SIZE;
+        }
+        if(n > len) {
+                n = len;
+        }
+        if(n == 0) {
+                return 0;
+        }
+        first = n < SHM_RING_SIZE - pos ? n : SHM_RING_SIZE - pos;
+        memcpy(buf, r->data + pos, first);
+        memcpy(buf + first, r->data, n - first);
+        __atomic_store_n(&r->head, head + n, __ATOMIC_RELEASE);
+
+        //head를 올린 뒤에 확인해야 생산자가 다시 확인할 때 빈 공간을 봄
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if(__atomic_load_n(&r->writer_wait, __ATOMIC_RELAXED)) {
+                wake(e->peer_fd);
+        }
+        return n;
+}
+
+//링의 빈 공간, 상대가 head를 망가뜨렸으면 -1
+static int64_t ring_room(struct shm_ring *r, uint32_t tail) {
+        uint32_t used = tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE);
+
+        if(used > SHM_RING_SIZE) {
+                return -1;
+        }
+        return SHM_RING_SIZE - used;
+}
+
+//들어가는 만큼 복사하고 보낸 바이트 수 반환, 가득 차서 하나도 못 쓰면 0 (상대가 읽으면 wake_fd로 깨워줌)
+//인덱스가 링 크기를 넘으면 -1 (EPROTO, shm_read와 같음)
+ssize_t shm_writev(struct shm_end *e, struct iovec *iov, int n) {
+        struct shm_ring *r = e->out;
+        uint32_t tail = __atomic_load_n(&r->tail, __ATOMIC_RELAXED), pos, len, first, left, total = 0;
+        int64_t room;
+        int i;
+
+        room = ring_room(r, tail);
+        if(room == 0) {
+                //기다린다고 표시한 뒤 다시 확인 (그 사이 읽었으면 바로 진행)
+                __atomic_store_n(&r->writer_wait, 1, __ATOMIC_RELAXED);
+                __atomic_thread_fence(__ATOMIC_SEQ_CST);
+                room = ring_room(r, tail);
+                if(room == 0) {
+                        return 0;
+                }
+        }
+        if(room == -1) {
+                errno = EPROTO;
+                return -1;
+        }
+        //여기부터는 0 < room <= SHM_RING_SIZE
+        left = (uint32_t)room;
+        if(r->writer_wait) {
+                __atomic_store_n(&r->writer_wait, 0, __ATOMIC_RELAXED);
+        }
+
+        for(i = 0 ; i < n && left > 0 ; i++) {
+                len = iov[i].iov_len < left ? iov[i].iov_len : left;
+                pos = tail & RING_MASK;
+                first = len < SHM_RING_SIZE - pos ? len : SHM_RING_SIZE - pos;
+                memcpy(r->data + pos, iov[i].iov_base, first);
+                memcpy(r->data, (char *)iov[i].iov_base + first, len - first);
+                tail += len;
+                left -= len;
+                total += len;
+        }
+        __atomic_store_n(&r->tail, tail, __ATOMIC_RELEASE);
+
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if(__atomic_load_n(&r->reader_wait, __ATOMIC_RELAXED)) {
+                wake(e->peer_fd);
+        }
+        return total;
+}
+
+//잠들기 전에 호출, 그 사이 데이터가 들어왔으면 0 (다시 읽어야 함)
+int shm_sleep(struct shm_end *e) {
+        struct shm_ring *r = e->in;
+
+        __atomic_store_n(&r->reader_wait, 1, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if(__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) != r->head) {
+                __atomic_store_n(&r->reader_wait, 0, __ATOMIC_RELAXED);
+                return 0;
+        }
+        return 1;
+}
+
+//wake_fd로 깨어난 뒤 호출, 깨어 있는 동안은 상대가 eventfd를 쓰지 않음
+void shm_woken(struct shm_end *e) {
+        uint64_t cnt;
+
+        read(e->wake_fd, &cnt, sizeof(cnt));
+        __atomic_store_n(&e->in->reader_wait, 0, __ATOMIC_RELAXED);
+}
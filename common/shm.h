@@ -0,0 +1,51 @@
+#ifndef SHM_H
+#define SHM_H
+
+#include <stdint.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+
+//같은 호스트 클라이언트용 공유 메모리 전송
+//UNIX 소켓으로 접속한 클라이언트가 빈 FT_SHM을 보내면 서버가 링 2개를 담은 memfd와 eventfd 2개를 넘겨줌
+//그 뒤로는 소켓과 같은 프레임 바이트를 링으로 주고받고, 소켓은 연결 종료를 알리는 데만 씀
+//링마다 생산자 1개, 소비자 1개 (SPSC), 상대가 잠들어 있을 때만 eventfd로 깨움
+//링 인덱스는 상대도 쓸 수 있으므로 읽고 쓸 때마다 범위를 확인하고, 넘으면 -1 (연결을 끊음)
+
+#define SHM_RING_SIZE (1 << 18)         //방향별 링 크기 (2의 거듭제곱)
+
+//누가 여는지
+#define SHM_SERVER 0
+#define SHM_CLIENT 1
+
+struct shm_ring {
+        //소비자만 씀
+        uint32_t head __attribute__((aligned(64)));
+        uint32_t reader_wait;           //소비자가 잠듦, 생산자가 쓰고 나서 깨움
+        //생산자만 씀
+        uint32_t tail __attribute__((aligned(64)));
+        uint32_t writer_wait;           //가득 차서 생산자가 기다림, 소비자가 읽고 나서 깨움
+        char data[SHM_RING_SIZE] __attribute__((aligned(64)));
+};
+
+struct shm_area {
+        struct shm_ring c2s;            //클라이언트 -> 서버
+        struct shm_ring s2c;            //서버 -> 클라이언트
+};
+
+//한쪽 끝
+struct shm_end {
+        struct shm_area *area;
+        struct shm_ring *in, *out;
+        int wake_fd;                    //내가 기다리는 eventfd
+        int peer_fd;                    //상대를 깨우는 eventfd
+};
+
+int shm_create(int *memfd, int *srv_fd, int *clnt_fd);
+int shm_attach(struct shm_end *e, int memfd, int srv_fd, int clnt_fd, int side);
+void shm_detach(struct shm_end *e);
+ssize_t shm_read(struct shm_end *e, char *buf, unsigned len);
+ssize_t shm_writev(struct shm_end *e, struct iovec *iov, int n);
+int shm_sleep(struct shm_end *e);
+void shm_woken(struct shm_end *e);
+
+#endif
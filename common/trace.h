@@ -0,0 +1,24 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+//정적 트레이스 포인트 (USDT) : -DUSDT로 빌드하면 <sys/sdt.h>의 프로브를 심음 (systemtap-sdt-dev 필요)
+//프로브 자리는 nop 1개이고 bpftrace/perf가 붙을 때만 동작, 끄면 인자 계산까지 통째로 빠짐
+//provider는 서버 serv, 클라이언트 clnt (프로브 목록과 bpftrace 스크립트는 README의 Tracing 참고)
+
+#ifdef USDT
+
+#include <sys/sdt.h>
+
+#define TRACE1(p, n, a) DTRACE_PROBE1(p, n, a)
+#define TRACE2(p, n, a, b) DTRACE_PROBE2(p, n, a, b)
+#define TRACE3(p, n, a, b, c) DTRACE_PROBE3(p, n, a, b, c)
+
+#else
+
+#define TRACE1(p, n, a) do { } while(0)
+#define TRACE2(p, n, a, b) do { } while(0)
+#define TRACE3(p, n, a, b, c) do { } while(0)
+
+#endif
+
+#endif
@@ -0,0 +1,260 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <arpa/inet.h>
+#include "serv.h"
+#include "conn.h"
+#include "log.h"
+#include "metrics.h"
+#include "lockstat.h"
+#include "admin.h"
+
+#define DIFF_N 4                //proto.c의 난이도 수 (NONE 포함)
+
+//matches 명령 : 난이도 하나에 속한 플레이어
+struct match_arg {
+        FILE *out;
+        int difficulty;
+        int n;
+};
+
+static int admin_sock = -1;
+static pthread_mutex_t limit_lock = PTHREAD_MUTEX_INITIALIZER;   //세션끼리 limit이 겹치지 않게 (parse_limit은 strtok 사용)
+
+static void *admin_loop(void *arg);
+static void *admin_session(void *arg);
+static void admin_cmd(FILE *out, char *line);
+static void list_one(struct conn *c, void *arg);
+static void match_one(struct conn *c, void *arg);
+static void cmd_matches(FILE *out);
+static void cmd_kick(FILE *out, char *arg);
+static void cmd_limit(FILE *out, char *arg);
+static void cmd_log(FILE *out, char *arg);
+
+//연결 하나 (잠금 없이 읽은 값), 이름은 바뀌는 중일 수 있으므로 복사해서 끝을 막음
+static void list_one(struct conn *c, void *arg) {
+        FILE *out = (FILE *)arg;
+        char ip[INET_ADDRSTRLEN], name[NAME_SIZE];
+
+        memcpy(name, c->player.name, NAME_SIZE);
+        name[NAME_SIZE - 1] = 0;
+        inet_ntop(AF_INET, &c->peer.sin_addr, ip, sizeof(ip));
+        fprintf(out, "#%08x fd %d %s [%s] : in %ld, out %ld in %ld sends, queued %ld msgs / %ld bytes, ring lag %ld, drop %ld, coalesce %ld, limited %ld, up %lds\n",
+                __atomic_load_n(&c->id, __ATOMIC_RELAXED), __atomic_load_n(&c->fd, __ATOMIC_RELAXED), ip, name,
+                __atomic_load_n(&c->st.msgs_in, __ATOMIC_RELAXED), __atomic_load_n(&c->st.msgs_out, __ATOMIC_RELAXED),
+                __atomic_load_n(&c->st.flushes, __ATOMIC_RELAXED), conn_queued(c),
+                __atomic_load_n(&c->outq.bytes, __ATOMIC_RELAXED), conn_lag(c),
+                __atomic_load_n(&c->bp.drop, __ATOMIC_RELAXED), __atomic_load_n(&c->bp.coalesce, __ATOMIC_RELAXED),
+                __atomic_load_n(&c->st.limited, __ATOMIC_RELAXED), (long)(time(NULL) - c->st.since));
+}
+
+//READY를 한 번이라도 보낸 연결만 (대결 상대는 클라이언트끼리 정하므로 난이도별로 묶어서 보여줌)
+static void match_one(struct conn *c, void *arg) {
+        struct match_arg *m = (struct match_arg *)arg;
+        struct player *p = &c->player;
+        char name[NAME_SIZE];
+
+        if(__atomic_load_n(&p->id, __ATOMIC_RELAXED) == 0 || __atomic_load_n(&p->difficulty, __ATOMIC_RELAXED) != m->difficulty) {
+                return;
+        }
+        memcpy(name, p->name, NAME_SIZE);
+        name[NAME_SIZE - 1] = 0;
+        fprintf(m->out, "  #%08x [%s] %s, score %d%s\n", __atomic_load_n(&c->id, __ATOMIC_RELAXED), name,
+                __atomic_load_n(&p->ready, __ATOMIC_RELAXED) ? "ready" : "waiting",
+                __atomic_load_n(&p->score, __ATOMIC_RELAXED), __atomic_load_n(&p->end, __ATOMIC_RELAXED) ? ", finished" : "");
+        m->n++;
+}
+
+static void cmd_matches(FILE *out) {
+        struct match_arg m;
+
+        m.out = out;
+        for(m.difficulty = 0 ; m.difficulty < DIFF_N ; m.difficulty++) {
+                fprintf(out, "%s :\n", proto_diff_name(m.difficulty));
+                m.n = 0;
+                conn_scan(match_one, &m);
+                if(m.n == 0) {
+                        fprintf(out, "  (none)\n");
+                }
+        }
+}
+
+//id는 다른 출력과 같은 16진수 (앞의 #은 있어도 됨)
+static void cmd_kick(FILE *out, char *arg) {
+        unsigned id;
+        char *end;
+
+        if(arg == NULL) {
+                fprintf(out, "usage : kick <id>\n");
+                return;
+        }
+        if(*arg == '#') {
+                arg++;
+        }
+        id = strtoul(arg, &end, 16);
+        if(end == arg || *end != 0) {
+                fprintf(out, "bad id %s\n", arg);
+        } else if(conn_kick(id) == -1) {
+                fprintf(out, "#%08x not found\n", id);
+        } else {
+                fprintf(out, "#%08x kicked\n", id);
+        }
+}
+
+//-q와 같은 형식, 하나라도 틀리면 전부 되돌림 (리액터는 다음 메시지부터 새 값을 읽음)
+static void cmd_limit(FILE *out, char *arg) {
+        static char *names[RL_N] = { "all", "bytes", "text", "ready", "result" };
+        struct rl_conf old[RL_N];
+        int action = conf.rl_action, i;
+
+        LOCK(&limit_lock);
+        if(arg != NULL) {
+                memcpy(old, conf.rl, sizeof(old));
+                if(parse_limit(arg) == -1) {
+                        memcpy(conf.rl, old, sizeof(old));
+                        conf.rl_action = action;
+                        UNLOCK(&limit_lock);
+                        fprintf(out, "bad limit (name=rate/burst,...,drop|kick)\n");
+                        return;
+                }
+        }
+        for(i = 0 ; i < RL_N ; i++) {
+                if(conf.rl[i].rate > 0) {
+                        fprintf(out, "%s=%ld/%ld,", names[i], conf.rl[i].rate, conf.rl[i].burst);
+                }
+        }
+        fprintf(out, "%s\n", conf.rl_action == RL_KICK ? "kick" : "drop");
+        UNLOCK(&limit_lock);
+}
+
+static void cmd_log(FILE *out, char *arg) {
+        static char *names[] = { "debug", "info", "warn", "error" };
+        int level;
+
+        if(arg != NULL) {
+                level = log_parse_level(arg);
+                if(level == -1) {
+                        fprintf(out, "bad level %s (debug|info|warn|error)\n", arg);
+                        return;
+                }
+                __atomic_store_n(&log_level, level, __ATOMIC_RELAXED);
+        }
+        fprintf(out, "log level %s\n", names[__atomic_load_n(&log_level, __ATOMIC_RELAXED)]);
+}
+
+static void admin_cmd(FILE *out, char *line) {
+        char *cmd, *arg, *save;
+
+        cmd = strtok_r(line, " \t\r\n", &save);
+        arg = strtok_r(NULL, " \t\r\n", &save);
+        if(cmd == NULL) {
+                return;
+        }
+        if(!strcmp(cmd, "conns")) {
+                conn_scan(list_one, out);
+                fprintf(out, "%d clients\n", conn_count());
+        } else if(!strcmp(cmd, "matches")) {
+                cmd_matches(out);
+        } else if(!strcmp(cmd, "stats")) {
+                conn_totals(out);
+        } else if(!strcmp(cmd, "kick")) {
+                cmd_kick(out, arg);
+        } else if(!strcmp(cmd, "limit")) {
+                cmd_limit(out, arg);
+        } else if(!strcmp(cmd, "log")) {
+                cmd_log(out, arg);
+        } else if(!strcmp(cmd, "metrics")) {
+                metrics_write(out);
+        } else {
+                fprintf(out, "commands : conns, matches, stats, kick <id>, limit [name=rate/burst,...,drop|kick],\n"
+                        "           log [debug|info|warn|error], metrics, quit\n");
+        }
+}
+
+//명령 한 줄에 응답 하나, 클라이언트가 끊거나 quit을 보내면 끝
+static void *admin_session(void *arg) {
+        int sock = (int)(intptr_t)arg;
+        char line[ADMIN_LINE];
+        FILE *in, *out;
+
+        in = fdopen(sock, "r");
+        out = in != NULL ? fdopen(dup(sock), "w") : NULL;
+        if(out == NULL) {
+                if(in != NULL) {
+                        fclose(in);
+                } else {
+                        close(sock);
+                }
+                return NULL;
+        }
+        while(fgets(line, sizeof(line), in) != NULL) {
+                if(!strncmp(line, "quit", 4)) {
+                        break;
+                }
+                admin_cmd(out, line);
+                if(fflush(out) == EOF) {
+                        break;
+                }
+        }
+        fclose(out);
+        fclose(in);
+        return NULL;
+}
+
+static void *admin_loop(void *arg) {
+        struct timespec ts = { 0, ADMIN_BACKOFF_MS * 1000000L };
+        pthread_t t_id;
+        int sock;
+
+        while(1) {
+                sock = accept(admin_sock, NULL, NULL);
+                if(sock == -1) {
+                        //EMFILE 등은 바로 다시 불러도 같은 에러라서 잠깐 쉼
+                        if(errno != EINTR && errno != ECONNABORTED) {
+                                nanosleep(&ts, NULL);
+                        }
+                        continue;
+                }
+                if(pthread_create(&t_id, NULL, admin_session, (void *)(intptr_t)sock) != 0) {
+                        close(sock);
+                        continue;
+                }
+                pthread_detach(t_id);
+        }
+        return NULL;
+}
+
+//path에서 받음 (이전 실행이 남긴 파일은 지움), 핫 리스타트 때는 새 프로세스가 같은 경로를 가져감
+int admin_start(char *path) {
+        struct sockaddr_un adr;
+        pthread_t t_id;
+
+        if(strlen(path) >= sizeof(adr.sun_path)) {
+                return -1;
+        }
+        admin_sock = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(admin_sock == -1) {
+                return -1;
+        }
+        memset(&adr, 0, sizeof(adr));
+        adr.sun_family = AF_UNIX;
+        strcpy(adr.sun_path, path);
+        unlink(path);
+        if(bind(admin_sock, (struct sockaddr *)&adr, sizeof(adr)) == -1 || listen(admin_sock, 4) == -1) {
+                close(admin_sock);
+                admin_sock = -1;
+                return -1;
+        }
+        if(pthread_create(&t_id, NULL, admin_loop, NULL) != 0) {
+                return -1;
+        }
+        pthread_detach(t_id);
+        return 0;
+}
@@ -0,0 +1,12 @@
+#ifndef ADMIN_H
+#define ADMIN_H
+
+//관리 콘솔 : UNIX 소켓으로 한 줄짜리 명령을 받아 텍스트로 응답 (-C)
+//연결 상태는 잠금 없이 읽으므로 부하 중에도 중계 경로를 막지 않음 (kick은 대상 연결의 lock만 잡고 표시와 shutdown만 함)
+
+#define ADMIN_LINE 256          //명령 한 줄 최대 길이
+#define ADMIN_BACKOFF_MS 100    //accept가 fd 부족 등으로 실패하면 쉬는 시간
+
+int admin_start(char *path);
+
+#endif
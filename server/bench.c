@@ -0,0 +1,340 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sched.h>
+#include <pthread.h>
+#include "../common/frame.h"
+#include "../common/proto.h"
+#include "../common/shm.h"
+
+//릴레이 서버 부하 측정 도구
+//clients개 연결 중 앞의 senders개가 msgs개씩 메시지를 보내고,
+//모든 연결이 받은 메시지의 지연 시간과 처리량을 출력
+//IP 대신 /경로를 주면 UNIX 소켓, shm:/경로를 주면 공유 메모리 링으로 전환해서 측정
+
+#define MSG_SIZE 50
+#define MAX_EVENTS 64
+
+struct bench_msg {
+        char tag[4];
+        uint32_t sender;
+        uint32_t seq;
+        uint64_t ts;
+        char pad[MSG_SIZE - 20];
+} __attribute__((packed));
+
+//연결별 수신 링
+struct bench_conn {
+        int sock;
+        struct shm_end *shm;    //공유 메모리로 전환했으면 NULL이 아님
+        struct frame_ring rx;
+};
+
+int n_clnt, n_sender, n_msg, interval_us;
+struct bench_conn *conns;
+uint64_t *lat;
+long lat_cnt = 0, expected, bad = 0;
+
+void *recv_thread(void *arg);
+int bench_connect(char *host, int port);
+struct shm_end *shm_start(int sock);
+void shm_send(struct shm_end *e, char *buf, int len);
+void shm_drain(struct bench_conn *c, uint64_t now);
+void count_frames(struct bench_conn *c, uint64_t now);
+void error_handling(char *buf);
+
+uint64_t now_ns(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+int cmp_u64(const void *a, const void *b) {
+        uint64_t x = *(uint64_t *)a, y = *(uint64_t *)b;
+        return x < y ? -1 : x > y;
+}
+
+int main(int argc, char *argv[]) {
+        struct bench_msg msg;
+        char out[FRAME_HDR_MAX + MSG_SIZE];
+        pthread_t t_id;
+        uint64_t start, elapsed;
+        int i, j, hlen, use_shm;
+
+        if(argc < 6) {
+                printf("Usage : %s <IP|/unix/path|shm:/unix/path> <port> <clients> <senders> <msgs> [interval_us]\n", argv[0]);
+                exit(1);
+        }
+        n_clnt = atoi(argv[3]);
+        n_sender = atoi(argv[4]);
+        n_msg = atoi(argv[5]);
+        interval_us = argc > 6 ? atoi(argv[6]) : 0;
+        if(n_sender > n_clnt) {
+                n_sender = n_clnt;
+        }
+
+        //서버는 보낸 연결에는 돌려주지 않음
+        expected = (long)n_sender * n_msg * (n_clnt - 1);
+        lat = malloc(sizeof(uint64_t) * expected);
+        conns = calloc(n_clnt, sizeof(struct bench_conn));
+        if(lat == NULL || conns == NULL) {
+                error_handling("malloc() error");
+        }
+
+        use_shm = !strncmp(argv[1], "shm:", 4);
+        for(i = 0 ; i < n_clnt ; i++) {
+                conns[i].sock = bench_connect(use_shm ? argv[1] + 4 : argv[1], atoi(argv[2]));
+                conns[i].shm = use_shm ? shm_start(conns[i].sock) : NULL;
+                if(frame_ring_init(&conns[i].rx, RING_INIT) == -1) {
+                        error_handling("frame_ring_init() error");
+                }
+        }
+        //서버가 모든 연결을 등록할 시간
+        usleep(200000);
+
+        pthread_create(&t_id, NULL, recv_thread, NULL);
+
+        memset(&msg, 0, sizeof(msg));
+        memcpy(msg.tag, "BNCH", 4);
+        hlen = frame_hdr(out, FT_TEXT, MSG_SIZE);
+        start = now_ns();
+        for(j = 0 ; j < n_msg ; j++) {
+                for(i = 0 ; i < n_sender ; i++) {
+                        msg.sender = i;
+                        msg.seq = j;
+                        msg.ts = now_ns();
+                        memcpy(out + hlen, &msg, MSG_SIZE);
+                        if(conns[i].shm != NULL) {
+                                shm_send(conns[i].shm, out, hlen + MSG_SIZE);
+                        } else if(write(conns[i].sock, out, hlen + MSG_SIZE) != hlen + MSG_SIZE) {
+                                error_handling("write() error");
+                        }
+                }
+                if(interval_us > 0) {
+                        usleep(interval_us);
+                }
+        }
+        pthread_join(t_id, NULL);
+        elapsed = now_ns() - start;
+
+        qsort(lat, lat_cnt, sizeof(uint64_t), cmp_u64);
+        printf("sent      : %d msgs x %d senders\n", n_msg, n_sender);
+        printf("delivered : %ld / %ld (bad %ld)\n", lat_cnt, expected, bad);
+        printf("elapsed   : %.3f s\n", elapsed / 1e9);
+        printf("rate      : %.0f msgs/s delivered\n", lat_cnt / (elapsed / 1e9));
+        if(lat_cnt > 0) {
+                printf("latency   : p50 %.1f us, p99 %.1f us, max %.1f us\n",
+                        lat[lat_cnt / 2] / 1e3, lat[lat_cnt * 99 / 100] / 1e3, lat[lat_cnt - 1] / 1e3);
+        }
+
+        for(i = 0 ; i < n_clnt ; i++) {
+                if(conns[i].shm != NULL) {
+                        shm_detach(conns[i].shm);
+                }
+                close(conns[i].sock);
+        }
+        return 0;
+}
+
+//host가 /로 시작하면 UNIX 소켓, 아니면 TCP
+int bench_connect(char *host, int port) {
+        struct sockaddr_in serv_adr;
+        struct sockaddr_un unix_adr;
+        int sock, on = 1;
+
+        if(host[0] == '/') {
+                memset(&unix_adr, 0, sizeof(unix_adr));
+                unix_adr.sun_family = AF_UNIX;
+                strncpy(unix_adr.sun_path, host, sizeof(unix_adr.sun_path) - 1);
+                sock = socket(AF_UNIX, SOCK_STREAM, 0);
+                if(connect(sock, (struct sockaddr*)&unix_adr, sizeof(unix_adr)) == -1) {
+                        error_handling("connect() error");
+                }
+                return sock;
+        }
+        memset(&serv_adr, 0, sizeof(serv_adr));
+        serv_adr.sin_family = AF_INET;
+        serv_adr.sin_addr.s_addr = inet_addr(host);
+        serv_adr.sin_port = htons(port);
+        sock = socket(PF_INET, SOCK_STREAM, 0);
+        if(connect(sock, (struct sockaddr*)&serv_adr, sizeof(serv_adr)) == -1) {
+                error_handling("connect() error");
+        }
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        return sock;
+}
+
+//빈 FT_SHM을 보내고 응답과 같이 온 memfd, eventfd 2개로 링을 매핑
+struct shm_end *shm_start(int sock) {
+        char buf[64], ctl[CMSG_SPACE(sizeof(int) * 3)];
+        struct shm_end *e;
+        struct proto_shm *ps;
+        struct cmsghdr *cm;
+        struct msghdr mh;
+        struct iovec iov;
+        struct frame f;
+        int fds[3], n, len = 0, pos;
+
+        n = frame_hdr(buf, FT_SHM, 0);
+        if(write(sock, buf, n) != n) {
+                error_handling("write() error");
+        }
+        //먼저 온 HELLO는 건너뜀, 응답은 fd와 같이 오므로 응답을 읽은 recvmsg의 제어 메시지를 씀
+        while(1) {
+                memset(&mh, 0, sizeof(mh));
+                iov.iov_base = buf + len;
+                iov.iov_len = sizeof(buf) - len;
+                mh.msg_iov = &iov;
+                mh.msg_iovlen = 1;
+                mh.msg_control = ctl;
+                mh.msg_controllen = sizeof(ctl);
+                n = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+                if(n <= 0) {
+                        error_handling("shm handshake error");
+                }
+                len += n;
+                for(pos = 0 ; (n = frame_parse(buf + pos, len - pos, &f)) > 0 && f.type != FT_SHM ; pos += n) {
+                }
+                if(n == -1 || (n == 0 && len == sizeof(buf))) {
+                        error_handling("shm handshake error");
+                }
+                if(n > 0) {
+                        break;
+                }
+                memmove(buf, buf + pos, len - pos);
+                len -= pos;
+        }
+        ps = proto_shm_dec(f.data, f.len);
+        if(ps == NULL || !ps->ok) {
+                error_handling("server refused shm (only epoll mode supports it)");
+        }
+        cm = CMSG_FIRSTHDR(&mh);
+        if(cm == NULL || cm->cmsg_type != SCM_RIGHTS || cm->cmsg_len != CMSG_LEN(sizeof(fds))) {
+                error_handling("shm handshake error");
+        }
+        memcpy(fds, CMSG_DATA(cm), sizeof(fds));
+        e = malloc(sizeof(*e));
+        if(e == NULL || shm_attach(e, fds[0], fds[1], fds[2], SHM_CLIENT) == -1) {
+                error_handling("shm_attach() error");
+        }
+        close(fds[0]);
+        return e;
+}
+
+//링이 가득 차면 서버가 읽을 때까지 양보하면서 다시 시도
+void shm_send(struct shm_end *e, char *buf, int len) {
+        struct iovec iov;
+        ssize_t n;
+
+        while(len > 0) {
+                iov.iov_base = buf;
+                iov.iov_len = len;
+                n = shm_writev(e, &iov, 1);
+                if(n == -1) {
+                        error_handling("shm_writev() error");
+                }
+                if(n == 0) {
+                        sched_yield();
+                        continue;
+                }
+                buf += n;
+                len -= n;
+        }
+}
+
+//받은 프레임마다 지연 시간 기록
+void count_frames(struct bench_conn *c, uint64_t now) {
+        struct bench_msg *m;
+        struct frame f;
+
+        while(frame_ring_next(&c->rx, &f) == 1) {
+                //HELLO, PING 등은 세지 않음
+                if(f.type != FT_TEXT) {
+                        continue;
+                }
+                m = (struct bench_msg *)f.data;
+                if(f.len != MSG_SIZE || memcmp(m->tag, "BNCH", 4) != 0 || lat_cnt >= expected) {
+                        bad++;
+                        continue;
+                }
+                lat[lat_cnt++] = now - m->ts;
+        }
+}
+
+//wake_fd로 깨어나면 링이 빌 때까지 읽고 다시 잠듦
+void shm_drain(struct bench_conn *c, uint64_t now) {
+        unsigned room;
+        ssize_t n;
+        char *p;
+
+        shm_woken(c->shm);
+        while(1) {
+                p = frame_ring_space(&c->rx, &room);
+                if(p == NULL) {
+                        error_handling("frame_ring_space() error");
+                }
+                n = shm_read(c->shm, p, room);
+                if(n == -1) {
+                        error_handling("shm_read() error");
+                }
+                if(n > 0) {
+                        frame_ring_commit(&c->rx, n);
+                        count_frames(c, now);
+                        now = now_ns();
+                } else if(shm_sleep(c->shm)) {
+                        return;
+                }
+        }
+}
+
+//모든 연결을 epoll로 받으면서 메시지별 지연 시간 기록, 2초간 아무것도 안 오면 종료
+void *recv_thread(void *arg) {
+        struct epoll_event ev, events[MAX_EVENTS];
+        struct bench_conn *c;
+        int epfd, n, i, str_len;
+        uint64_t now;
+
+        epfd = epoll_create1(0);
+        for(i = 0 ; i < n_clnt ; i++) {
+                ev.events = EPOLLIN;
+                ev.data.ptr = &conns[i];
+                epoll_ctl(epfd, EPOLL_CTL_ADD, conns[i].shm != NULL ? conns[i].shm->wake_fd : conns[i].sock, &ev);
+        }
+
+        while(lat_cnt < expected) {
+                n = epoll_wait(epfd, events, MAX_EVENTS, 2000);
+                if(n <= 0) {
+                        break;
+                }
+                for(i = 0 ; i < n ; i++) {
+                        c = events[i].data.ptr;
+                        if(c->shm != NULL) {
+                                shm_drain(c, now_ns());
+                                continue;
+                        }
+                        str_len = frame_ring_read(&c->rx, c->sock);
+                        if(str_len <= 0) {
+                                continue;
+                        }
+                        now = now_ns();
+                        count_frames(c, now);
+                }
+        }
+        close(epfd);
+        return NULL;
+}
+
+void error_handling(char *buf) {
+        fputs(buf, stderr);
+        fputc('\n', stderr);
+        exit(1);
+}
@@ -0,0 +1,114 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+#include "../common/proto.h"
+
+//메시지 인코딩/디코딩 비용 측정
+//기존 텍스트 방식(sprintf + strtok/atoi)과 바이너리 방식을 같은 내용으로 비교
+
+#define NAME_SIZE 20
+
+struct player {
+        uint32_t id;
+        char name[NAME_SIZE];
+        char difficulty[16];
+        int ready;
+        int score;
+};
+
+volatile int sink;
+
+uint64_t now_ns(void) {
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//클라이언트가 하던 방식 그대로
+int text_enc(char *out, struct player *p) {
+        return sprintf(out, "READY %s %s %d %d", p->name, p->difficulty, p->ready, p->score);
+}
+
+void text_dec(char *msg, struct player *me, struct player *rival) {
+        char *tmp;
+
+        tmp = strtok(msg, " ");
+        if(strcmp(tmp, "READY")) {
+                return;
+        }
+        tmp = strtok(NULL, " ");
+        if(!strcmp(tmp, me->name)) {
+                return;
+        }
+        strcpy(rival->name, tmp);
+        tmp = strtok(NULL, " ");
+        strcpy(rival->difficulty, tmp);
+        tmp = strtok(NULL, " ");
+        rival->ready = atoi(tmp);
+        tmp = strtok(NULL, " ");
+        rival->score = atoi(tmp);
+}
+
+int bin_enc(char *out, struct player *p) {
+        return proto_ready_enc(out, p->id, proto_diff_parse(p->difficulty), p->ready, p->score, p->name);
+}
+
+//구조체로 바로 읽고 정수 비교만 함
+void bin_dec(char *msg, int len, struct player *me, struct player *rival) {
+        struct proto_ready *m = proto_ready_dec(msg, len);
+
+        if(m == NULL || proto32(m->hdr.player) == me->id) {
+                return;
+        }
+        rival->id = proto32(m->hdr.player);
+        rival->ready = m->ready;
+        rival->score = proto16(m->score);
+        sink = m->difficulty + m->name_len;
+}
+
+int main(int argc, char *argv[]) {
+        struct player me = { 1, "alice", "INTERMEDIATE", 1, 7 };
+        struct player rival = { 2, "bob", "EXPERT", 1, 3 };
+        struct player out;
+        char text[128], work[128], bin[PROTO_READY_MAX];
+        int i, n, text_len = 0, bin_len = 0;
+        uint64_t t0, t_text_enc, t_text_dec, t_bin_enc, t_bin_dec;
+
+        n = argc > 1 ? atoi(argv[1]) : 10000000;
+
+        t0 = now_ns();
+        for(i = 0 ; i < n ; i++) {
+                rival.score = i & 0xff;
+                text_len = text_enc(text, &rival);
+        }
+        t_text_enc = now_ns() - t0;
+
+        t0 = now_ns();
+        for(i = 0 ; i < n ; i++) {
+                memcpy(work, text, text_len + 1);       //strtok이 버퍼를 고치므로 복사본 사용
+                text_dec(work, &me, &out);
+        }
+        t_text_dec = now_ns() - t0;
+
+        t0 = now_ns();
+        for(i = 0 ; i < n ; i++) {
+                rival.score = i & 0xff;
+                bin_len = bin_enc(bin, &rival);
+        }
+        t_bin_enc = now_ns() - t0;
+
+        t0 = now_ns();
+        for(i = 0 ; i < n ; i++) {
+                bin_dec(bin, bin_len, &me, &out);
+        }
+        t_bin_dec = now_ns() - t0;
+
+        printf("READY x %d\n", n);
+        printf("text   : %3d bytes, encode %6.1f ns, decode %6.1f ns\n",
+                text_len, (double)t_text_enc / n, (double)t_text_dec / n);
+        printf("binary : %3d bytes, encode %6.1f ns, decode %6.1f ns\n",
+                bin_len, (double)t_bin_enc / n, (double)t_bin_dec / n);
+        return 0;
+}
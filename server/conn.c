@@ -0,0 +1,1834 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <sched.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <arpa/inet.h>
+#include "serv.h"
+#include "conn.h"
+#include "log.h"
+#include "registry.h"
+#include "lockstat.h"
+#include "metrics.h"
+#include "../common/trace.h"
+
+//fd -> 연결 테이블, TAB_CHUNK개 단위로 필요할 때 할당하고 해제하지 않음
+//(포인터가 옮겨지지 않으므로 소유 스레드는 잠금 없이 조회)
+static struct conn **tab_dir[TAB_DIR];
+static pthread_mutex_t tab_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//브로드캐스트용 연결 목록, fd % N_SHARD로 나눠서 샤드별 잠금
+//삭제는 마지막 원소와 자리를 바꿔서 O(1)
+struct shard {
+        pthread_mutex_t lock;
+        struct conn **member;
+        int cnt, cap;
+} __attribute__((aligned(64)));
+
+static struct shard shards[N_SHARD];
+static int conn_cnt = 0;
+
+//연결 풀 : SLAB_CHUNK개씩 할당해서 free list로 관리, 한 번 만든 chunk는 해제하지 않음
+static struct conn *slab_dir[SLAB_DIR];
+static int slab_chunks = 0;
+static struct conn *free_list = NULL;
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+
+//송신 큐 정책 전체 발동 횟수
+static struct bp_stats bp_total;
+
+//속도 제한 전체 횟수
+static long rl_drop_total, rl_kick_total;
+
+//새 접속 속도 제한 (accept하는 스레드가 여럿일 수 있어서 잠금)
+static struct bucket admit_bucket;
+static pthread_mutex_t admit_lock = PTHREAD_MUTEX_INITIALIZER;
+static long busy_total[2];      //BUSY_FULL, BUSY_RATE
+
+//모든 연결이 같이 쓰는 하트비트 프레임 (참조를 하나 계속 잡고 있어서 해제되지 않음)
+static struct msgbuf *ping_buf, *pong_buf;
+static struct msgbuf *shm_no_buf;       //공유 메모리 전환 거절
+
+//브로드캐스트 링 (epoll 리액터 모드), NULL이면 연결마다 송신 큐에 넣음
+//게시하는 리액터가 여럿이므로 순번은 원자적으로 받고, 슬롯의 seq로 게시 완료를 알림
+static struct bslot *bring;
+static uint64_t bring_mask;
+static uint64_t bring_next __attribute__((aligned(64))) = 1;   //다음에 받을 순번
+static uint64_t bring_gate __attribute__((aligned(64))) = 1;   //모든 연결의 읽기 위치 중 최소 (이 순번부터는 덮어쓰면 안 됨)
+static pthread_mutex_t gate_lock = PTHREAD_MUTEX_INITIALIZER;   //게이트 계산, 연결 등록
+static long bring_spill_total, bring_wait_total;
+static struct flushq *fq_all;           //깨울 리액터 목록 (리액터를 띄우기 전에 등록)
+
+static void conn_on_timer(struct timer *t);
+static void flushq_del(struct conn *c);
+static void conn_reply(struct conn *c, char *data, int len);
+static int send_direct(struct conn *c, unsigned id, struct msgbuf *buf);
+static long m_conns(void);
+static long m_names(void);
+static void queue_scan(void);
+static long m_outq_msgs(void);
+static long m_outq_bytes(void);
+static long m_ring_lag(void);
+
+struct msgbuf *msgbuf_new(char *data, int len) {
+        struct msgbuf *buf = malloc(sizeof(struct msgbuf) + len + 1);
+
+        if(buf == NULL) {
+                return NULL;
+        }
+        memcpy(buf->data, data, len);
+        buf->data[len] = 0;
+        buf->len = len;
+        buf->ref = 1;
+        buf->kind = MSG_NORMAL;
+        buf->key = 0;
+        buf->ts = 0;
+        return buf;
+}
+
+void msgbuf_hold(struct msgbuf *buf) {
+        __atomic_add_fetch(&buf->ref, 1, __ATOMIC_RELAXED);
+}
+
+void msgbuf_put(struct msgbuf *buf) {
+        if(__atomic_sub_fetch(&buf->ref, 1, __ATOMIC_ACQ_REL) == 0) {
+                free(buf);
+        }
+}
+
+//풀에 chunk 하나 추가 (pool_lock 안에서 호출)
+static int pool_grow(void) {
+        struct conn *chunk, *c;
+        int i;
+
+        if(slab_chunks == SLAB_DIR) {
+                return -1;
+        }
+        chunk = calloc(SLAB_CHUNK, sizeof(struct conn));
+        if(chunk == NULL) {
+                return -1;
+        }
+        for(i = SLAB_CHUNK - 1 ; i >= 0 ; i--) {
+                c = &chunk[i];
+                c->id = (1U << ID_SLOT_BITS) | (slab_chunks * SLAB_CHUNK + i);
+                c->fd = -1;
+                c->closed = 1;
+                c->outq.ring = c->ring0;
+                c->outq.cap = OUTQ_INIT;
+                pthread_mutex_init(&c->lock, NULL);
+                pthread_mutex_init(&c->wlock, NULL);
+                c->free_next = free_list;
+                free_list = c;
+        }
+        __atomic_store_n(&slab_dir[slab_chunks], chunk, __ATOMIC_RELEASE);
+        slab_chunks++;
+        return 0;
+}
+
+static struct conn *pool_alloc(void) {
+        struct conn *c;
+
+        LOCK(&pool_lock);
+        if(free_list == NULL && pool_grow() == -1) {
+                UNLOCK(&pool_lock);
+                return NULL;
+        }
+        c = free_list;
+        free_list = c->free_next;
+        UNLOCK(&pool_lock);
+        return c;
+}
+
+//세대 번호를 올려서 돌려놓음 (0세대는 건너뜀, 커진 송신 큐는 그대로 재사용)
+static void pool_free(struct conn *c) {
+        unsigned id = c->id + (1U << ID_SLOT_BITS);
+
+        if((id >> ID_SLOT_BITS) == 0) {
+                id += 1U << ID_SLOT_BITS;
+        }
+        __atomic_store_n(&c->id, id, __ATOMIC_RELEASE);
+
+        LOCK(&pool_lock);
+        c->free_next = free_list;
+        free_list = c;
+        UNLOCK(&pool_lock);
+}
+
+//송신 큐에 남은 메시지 수 (잠금 없이 읽음)
+long conn_queued(struct conn *c) {
+        return __atomic_load_n(&c->outq.tail, __ATOMIC_RELAXED) - __atomic_load_n(&c->outq.head, __ATOMIC_RELAXED);
+}
+
+//브로드캐스트 링에서 아직 보내지 않은 슬롯 수 (자기 메시지 포함), 링을 읽지 않는 연결은 0
+long conn_lag(struct conn *c) {
+        uint64_t next, cur;
+
+        if(bring == NULL || __atomic_load_n(&c->fq_idx, __ATOMIC_RELAXED) == -1) {
+                return 0;
+        }
+        next = __atomic_load_n(&bring_next, __ATOMIC_ACQUIRE);
+        cur = __atomic_load_n(&c->bcur, __ATOMIC_RELAXED);
+        return next > cur ? next - cur : 0;
+}
+
+//메트릭 게이지 (읽을 때만 호출)
+static long m_conns(void) {
+        return conn_count();
+}
+
+static long m_names(void) {
+        return name_count();
+}
+
+//송신 대기 합계, 잠금 없이 읽음 (스크레이프마다 queue_scan이 한 번 채움)
+struct queue_sum {
+        long msgs;
+        long bytes;
+        long lag;               //브로드캐스트 링에서 가장 밀린 연결의 남은 슬롯 수
+};
+
+static void queue_one(struct conn *c, void *arg) {
+        struct queue_sum *q = (struct queue_sum *)arg;
+        long lag = conn_lag(c);
+
+        q->msgs += conn_queued(c);
+        q->bytes += __atomic_load_n(&c->outq.bytes, __ATOMIC_RELAXED);
+        if(lag > q->lag) {
+                q->lag = lag;
+        }
+}
+
+static struct queue_sum q_last;         //마지막 스크레이프의 합계 (metrics의 scrape_lock 안에서만 씀)
+
+//잠금 없이 읽으므로 전송 중인 연결은 조금씩 어긋날 수 있음, 게이지 3개가 이 결과를 같이 씀
+static void queue_scan(void) {
+        memset(&q_last, 0, sizeof(q_last));
+        conn_scan(queue_one, &q_last);
+}
+
+static long m_outq_msgs(void) {
+        return q_last.msgs;
+}
+
+static long m_outq_bytes(void) {
+        return q_last.bytes;
+}
+
+static long m_ring_lag(void) {
+        return q_last.lag;
+}
+
+void conn_init(int prealloc) {
+        char buf[FRAME_HDR_MAX + sizeof(struct proto_shm)];
+        struct rlimit rl;
+        int i, n;
+
+        //256명 이상 받을 수 있도록 fd 한도를 최대로
+        if(getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+                rl.rlim_cur = rl.rlim_max;
+                setrlimit(RLIMIT_NOFILE, &rl);
+        }
+
+        for(i = 0 ; i < N_SHARD ; i++) {
+                pthread_mutex_init(&shards[i].lock, NULL);
+        }
+
+        ping_buf = msgbuf_new("\0\3", 2);
+        pong_buf = msgbuf_new("\0\4", 2);
+        n = frame_hdr(buf, FT_SHM, sizeof(struct proto_shm));
+        n += proto_shm_enc(buf + n, 0, 0);
+        shm_no_buf = msgbuf_new(buf, n);
+        if(ping_buf == NULL || pong_buf == NULL || shm_no_buf == NULL) {
+                error_handling("malloc() error");
+        }
+
+        //accept/close 때 malloc하지 않도록 미리 할당
+        LOCK(&pool_lock);
+        while(slab_chunks * SLAB_CHUNK < prealloc && pool_grow() == 0) {
+        }
+        UNLOCK(&pool_lock);
+
+        metric_func("serv_connections", "Open connections", MT_GAUGE, m_conns);
+        metric_prep(queue_scan);
+        metric_func("serv_outq_messages", "Messages waiting in per-connection send queues", MT_GAUGE, m_outq_msgs);
+        metric_func("serv_outq_bytes", "Bytes waiting in per-connection send queues", MT_GAUGE, m_outq_bytes);
+        metric_func("serv_ring_lag_max", "Broadcast ring slots the slowest connection has not sent", MT_GAUGE, m_ring_lag);
+        metric_func("serv_names_registered", "Player names in the registry", MT_GAUGE, m_names);
+        metric_long("serv_outq_dropped_total", "Messages dropped by the send queue policy", MT_COUNTER, &bp_total.drop);
+        metric_long("serv_outq_coalesced_total", "State messages replaced by a newer one", MT_COUNTER, &bp_total.coalesce);
+        metric_long("serv_outq_kicked_total", "Connections closed for a full send queue", MT_COUNTER, &bp_total.disconnect);
+        metric_long("serv_rate_limited_total", "Inbound messages dropped by the rate limiter", MT_COUNTER, &rl_drop_total);
+        metric_long("serv_rate_kicked_total", "Connections closed by the rate limiter", MT_COUNTER, &rl_kick_total);
+        metric_long("serv_busy_full_total", "Connections refused at the connection limit", MT_COUNTER, &busy_total[BUSY_FULL]);
+        metric_long("serv_busy_rate_total", "Connections refused by the accept rate limit", MT_COUNTER, &busy_total[BUSY_RATE]);
+        metric_long("serv_ring_spilled_total", "Broadcast ring messages copied to a lagging connection's queue", MT_COUNTER, &bring_spill_total);
+}
+
+//fd에 해당하는 테이블 칸, create면 chunk가 없을 때 할당
+static struct conn **tab_slot(int fd, int create) {
+        struct conn **chunk;
+
+        if(fd < 0 || fd >= TAB_CHUNK * TAB_DIR) {
+                return NULL;
+        }
+        chunk = __atomic_load_n(&tab_dir[fd / TAB_CHUNK], __ATOMIC_ACQUIRE);
+        if(chunk == NULL && create) {
+                LOCK(&tab_lock);
+                chunk = tab_dir[fd / TAB_CHUNK];
+                if(chunk == NULL) {
+                        chunk = calloc(TAB_CHUNK, sizeof(struct conn *));
+                        __atomic_store_n(&tab_dir[fd / TAB_CHUNK], chunk, __ATOMIC_RELEASE);
+                }
+                UNLOCK(&tab_lock);
+        }
+        return chunk == NULL ? NULL : &chunk[fd % TAB_CHUNK];
+}
+
+static int shard_add(struct conn *c) {
+        struct shard *sh = &shards[c->fd % N_SHARD];
+        struct conn **member;
+        int cap;
+
+        LOCK(&sh->lock);
+        if(sh->cnt == sh->cap) {
+                cap = sh->cap ? sh->cap * 2 : 64;
+                member = realloc(sh->member, sizeof(struct conn *) * cap);
+                if(member == NULL) {
+                        UNLOCK(&sh->lock);
+                        return -1;
+                }
+                sh->member = member;
+                sh->cap = cap;
+        }
+        c->idx = sh->cnt;
+        sh->member[sh->cnt++] = c;
+        UNLOCK(&sh->lock);
+        return 0;
+}
+
+static void shard_del(struct conn *c) {
+        struct shard *sh = &shards[c->fd % N_SHARD];
+        struct conn *last;
+
+        LOCK(&sh->lock);
+        last = sh->member[--sh->cnt];
+        sh->member[c->idx] = last;
+        last->idx = c->idx;
+        UNLOCK(&sh->lock);
+}
+
+//연결 등록, 테이블이 가득 찼거나 풀을 늘릴 수 없으면 NULL
+struct conn *conn_new(int fd, struct flushq *fq, struct sockaddr_in *peer) {
+        struct conn **slot;
+        struct conn *c;
+        int i;
+
+        slot = tab_slot(fd, 1);
+        if(slot == NULL) {
+                return NULL;
+        }
+        c = pool_alloc();
+        if(c == NULL) {
+                return NULL;
+        }
+        //수신 링은 처음 쓸 때 만들고 이후에는 비우기만 함
+        if(c->rx.buf == NULL && frame_ring_init(&c->rx, RING_INIT) == -1) {
+                c->closed = 1;
+                pool_free(c);
+                return NULL;
+        }
+        frame_ring_reset(&c->rx);
+        c->wheel = NULL;
+        c->shm = NULL;
+        c->shm_req = 0;
+
+        //id, lock, 송신 큐 배열은 풀에서 유지되는 값
+        c->fd = fd;
+        c->peer = *peer;
+        c->ref = 1;
+        c->closed = 0;
+        c->scheduled = 0;
+        c->kill = 0;
+        c->sending = 0;
+        c->fq = NULL;
+        c->fq_next = NULL;
+        c->fq_idx = -1;
+        c->boff = c->bbusy = 0;
+        c->outq.head = c->outq.tail = 0;
+        c->outq.off = c->outq.busy = 0;
+        c->outq.bytes = 0;
+        memset(&c->bp, 0, sizeof(c->bp));
+        memset(&c->player, 0, sizeof(c->player));
+        memset(&c->st, 0, sizeof(c->st));
+        c->st.since = time(NULL);
+        //버킷은 가득 찬 상태로 시작
+        for(i = 0 ; i < RL_N ; i++) {
+                c->rl[i].tokens = conf.rl[i].burst * 1000;
+                c->rl[i].last = now_ms();
+        }
+
+        //게이트 계산과 겹치지 않게 등록해야 읽기 위치가 게이트보다 뒤로 가지 않음
+        LOCK(&gate_lock);
+        c->bcur = __atomic_load_n(&bring_next, __ATOMIC_RELAXED);
+        i = shard_add(c);
+        UNLOCK(&gate_lock);
+        if(i == -1) {
+                c->closed = 1;
+                pool_free(c);
+                return NULL;
+        }
+        if(fq != NULL && flushq_add(fq, c) == -1) {
+                shard_del(c);
+                c->closed = 1;
+                pool_free(c);
+                return NULL;
+        }
+        if(conf.lowlat != LL_OFF) {
+                set_lowlat(fd);
+        }
+        __atomic_store_n(slot, c, __ATOMIC_RELEASE);
+        __atomic_add_fetch(&conn_cnt, 1, __ATOMIC_RELAXED);
+        metric_add(M_ACCEPT, 1);
+        TRACE2(serv, accept, c->id, fd);
+        return c;
+}
+
+//소유 스레드에서만 호출
+struct conn *conn_get(int fd) {
+        struct conn **slot = tab_slot(fd, 0);
+
+        return slot == NULL ? NULL : __atomic_load_n(slot, __ATOMIC_ACQUIRE);
+}
+
+//id로 연결 찾기, 이미 닫혀서 풀에 돌아갔거나 재사용 중이면 NULL
+struct conn *conn_by_id(unsigned id) {
+        unsigned slot = id & ID_SLOT_MASK;
+        struct conn *chunk, *c;
+
+        if(slot / SLAB_CHUNK >= SLAB_DIR) {
+                return NULL;
+        }
+        chunk = __atomic_load_n(&slab_dir[slot / SLAB_CHUNK], __ATOMIC_ACQUIRE);
+        if(chunk == NULL) {
+                return NULL;
+        }
+        c = &chunk[slot % SLAB_CHUNK];
+        if(__atomic_load_n(&c->id, __ATOMIC_ACQUIRE) != id || c->closed) {
+                return NULL;
+        }
+        return c;
+}
+
+int conn_count(void) {
+        return __atomic_load_n(&conn_cnt, __ATOMIC_RELAXED);
+}
+
+//모든 연결에 대해 fn 호출, 샤드 하나씩만 잠그므로 등록/해제와 거의 경합하지 않음
+//fn 안에서는 그 연결을 닫으면 안 됨
+void conn_foreach(void (*fn)(struct conn *c, void *arg), void *arg) {
+        struct shard *sh;
+        int i, j;
+
+        for(i = 0 ; i < N_SHARD ; i++) {
+                sh = &shards[i];
+                LOCK(&sh->lock);
+                for(j = 0 ; j < sh->cnt ; j++) {
+                        fn(sh->member[j], arg);
+                }
+                UNLOCK(&sh->lock);
+        }
+}
+
+//conn_foreach와 같지만 샤드 목록을 복사하고 참조를 잡은 뒤 잠금 밖에서 fn 호출 (스레드 모드의 블로킹 쓰기)
+//fn이 막혀도 그 샤드의 등록/해제와 다른 스레드의 전달이 기다리지 않음, 닫히는 중인 연결이 올 수 있음
+void conn_fanout(void (*fn)(struct conn *c, void *arg), void *arg) {
+        static __thread struct conn **snap;
+        static __thread int snap_cap;
+        struct conn **v;
+        struct shard *sh;
+        int i, j, n;
+
+        for(i = 0 ; i < N_SHARD ; i++) {
+                sh = &shards[i];
+                LOCK(&sh->lock);
+                if(sh->cnt > snap_cap) {
+                        v = realloc(snap, sizeof(struct conn *) * sh->cap);
+                        if(v == NULL) {
+                                //복사할 자리가 없으면 예전처럼 잠금 안에서
+                                for(j = 0 ; j < sh->cnt ; j++) {
+                                        fn(sh->member[j], arg);
+                                }
+                                UNLOCK(&sh->lock);
+                                continue;
+                        }
+                        snap = v;
+                        snap_cap = sh->cap;
+                }
+                n = sh->cnt;
+                for(j = 0 ; j < n ; j++) {
+                        snap[j] = sh->member[j];
+                        conn_hold(snap[j]);
+                }
+                UNLOCK(&sh->lock);
+                for(j = 0 ; j < n ; j++) {
+                        fn(snap[j], arg);
+                        conn_put(snap[j]);
+                }
+        }
+}
+
+//풀 전체를 잠금 없이 훑으며 열린 연결마다 fn 호출 (관리 콘솔, 메트릭 게이지)
+//풀의 메모리는 해제되지 않으므로 읽어도 안전하지만 값은 순간적으로 어긋날 수 있음, fn에서 c->lock을 잡지 말 것
+void conn_scan(void (*fn)(struct conn *c, void *arg), void *arg) {
+        struct conn *chunk, *c;
+        int i, j;
+
+        for(i = 0 ; i < SLAB_DIR ; i++) {
+                chunk = __atomic_load_n(&slab_dir[i], __ATOMIC_ACQUIRE);
+                if(chunk == NULL) {
+                        break;
+                }
+                for(j = 0 ; j < SLAB_CHUNK ; j++) {
+                        c = &chunk[j];
+                        if(!__atomic_load_n(&c->closed, __ATOMIC_ACQUIRE)) {
+                                fn(c, arg);
+                        }
+                }
+        }
+}
+
+void conn_hold(struct conn *c) {
+        __atomic_add_fetch(&c->ref, 1, __ATOMIC_RELAXED);
+}
+
+void conn_put(struct conn *c) {
+        struct outq *q = &c->outq;
+
+        if(__atomic_sub_fetch(&c->ref, 1, __ATOMIC_ACQ_REL) != 0) {
+                return;
+        }
+        while(q->head != q->tail) {
+                msgbuf_put(q->ring[q->head++ & (q->cap - 1)]);
+        }
+        //flush 대기 중에도 링을 쓸 수 있으므로 마지막 참조에서 해제
+        if(c->shm != NULL) {
+                shm_detach(c->shm);
+                free(c->shm);
+                c->shm = NULL;
+        }
+        pool_free(c);
+}
+
+//목록에서 빼고 소켓을 닫음 (소유 스레드에서만 호출)
+//flush 대기 중이거나 전송 중인 참조가 남아 있으면 마지막 conn_put에서 해제
+void conn_close(struct conn *c) {
+        if(c->closed) {
+                return;
+        }
+        if(c->wheel != NULL) {
+                timer_del(c->wheel, &c->tm);
+        }
+        //샤드에서 빠진 뒤에는 브로드캐스트가 이 연결을 볼 수 없음
+        shard_del(c);
+        flushq_del(c);
+        __atomic_store_n(tab_slot(c->fd, 0), NULL, __ATOMIC_RELEASE);
+        if(c->shm != NULL) {
+                __atomic_store_n(tab_slot(c->shm->wake_fd, 0), NULL, __ATOMIC_RELEASE);
+        }
+        __atomic_sub_fetch(&conn_cnt, 1, __ATOMIC_RELAXED);
+        metric_add(M_CLOSE, 1);
+        TRACE3(serv, close, c->id, c->st.msgs_in, c->st.msgs_out);
+        if(c->player.login) {
+                name_release(c->player.name, c->id);
+        }
+
+        LOCK(&c->lock);
+        c->closed = 1;
+        UNLOCK(&c->lock);
+        LOG(LOG_INFO, EV_CLOSE, c->id, c->st.msgs_in, c->st.msgs_out);
+
+        //스레드 모드 : 다른 스레드가 쓰는 중이면 끝날 때까지 기다림 (막혀 있는 쓰기는 shutdown으로 깨움)
+        if(c->fq == NULL) {
+                shutdown(c->fd, SHUT_RDWR);
+                LOCK(&c->wlock);
+                close(c->fd);
+                UNLOCK(&c->wlock);
+        } else {
+                close(c->fd);
+        }
+        conn_put(c);
+}
+
+static void flushq_push(struct flushq *fq, struct conn *c) {
+        uint64_t one = 1;
+        int wake;
+
+        conn_hold(c);
+        LOCK(&fq->lock);
+        wake = fq->head == NULL;
+        c->fq_next = fq->head;
+        fq->head = c;
+        UNLOCK(&fq->lock);
+
+        //소유 스레드는 루프 끝에서 목록을 비우므로 깨울 필요 없음
+        if(wake && !pthread_equal(pthread_self(), __atomic_load_n(&fq->owner, __ATOMIC_ACQUIRE))) {
+                write(fq->efd, &one, sizeof(one));
+        }
+}
+
+//메시지를 n개, len 바이트 더 넣으면 한계를 넘는지
+static int outq_over(struct outq *q, int n, int len) {
+        return q->bytes + len > conf.hwm_bytes || (int)(q->tail - q->head) + n > conf.hwm_msgs;
+}
+
+//버리거나 교체할 수 있는 첫 위치 (전송 중이거나 일부만 보낸 메시지는 건드리지 않음)
+static unsigned outq_first_free(struct outq *q) {
+        if(q->busy == 0 && q->off > 0) {
+                return q->head + 1;
+        }
+        return q->head + q->busy;
+}
+
+static void outq_remove(struct outq *q, unsigned i) {
+        struct msgbuf *buf = q->ring[i & (q->cap - 1)];
+
+        for( ; i + 1 != q->tail ; i++) {
+                q->ring[i & (q->cap - 1)] = q->ring[(i + 1) & (q->cap - 1)];
+        }
+        q->tail--;
+        q->bytes -= buf->len;
+        msgbuf_put(buf);
+}
+
+//같은 플레이어의 이전 상태 메시지를 새 것으로 교체, 성공하면 1
+static int outq_coalesce(struct outq *q, struct msgbuf *buf) {
+        struct msgbuf *old;
+        unsigned i;
+
+        for(i = outq_first_free(q) ; i != q->tail ; i++) {
+                old = q->ring[i & (q->cap - 1)];
+                if(old->kind == MSG_STATE && old->key == buf->key) {
+                        msgbuf_hold(buf);
+                        q->ring[i & (q->cap - 1)] = buf;
+                        q->bytes += buf->len - old->len;
+                        msgbuf_put(old);
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+//가장 오래된 버릴 수 있는 메시지 1개 제거, 성공하면 1
+static int outq_drop_oldest(struct outq *q) {
+        unsigned i;
+
+        for(i = outq_first_free(q) ; i != q->tail ; i++) {
+                if(q->ring[i & (q->cap - 1)]->kind != MSG_CRITICAL) {
+                        outq_remove(q, i);
+                        return 1;
+                }
+        }
+        return 0;
+}
+
+//가득 찼으면 두 배로 늘림
+static int outq_grow(struct outq *q) {
+        struct msgbuf **ring;
+        unsigned i, n;
+
+        if(q->tail - q->head < q->cap) {
+                return 0;
+        }
+        ring = malloc(sizeof(struct msgbuf *) * q->cap * 2);
+        if(ring == NULL) {
+                return -1;
+        }
+        n = q->tail - q->head;
+        for(i = 0 ; i < n ; i++) {
+                ring[i] = q->ring[(q->head + i) & (q->cap - 1)];
+        }
+        if(q->cap > OUTQ_INIT) {
+                free(q->ring);
+        }
+        q->ring = ring;
+        q->head = 0;
+        q->tail = n;
+        q->cap *= 2;
+        return 0;
+}
+
+static int outq_push(struct outq *q, struct msgbuf *buf) {
+        if(outq_grow(q) == -1) {
+                return -1;
+        }
+        msgbuf_hold(buf);
+        q->ring[q->tail++ & (q->cap - 1)] = buf;
+        q->bytes += buf->len;
+        return 0;
+}
+
+//off 바이트까지 보낸 메시지를 맨 앞에 넣음 (송신 큐가 전송 중이 아니고 head를 일부만 보낸 상태가 아닐 때)
+static int outq_push_front(struct outq *q, struct msgbuf *buf, int off) {
+        if(outq_grow(q) == -1) {
+                return -1;
+        }
+        msgbuf_hold(buf);
+        q->ring[--q->head & (q->cap - 1)] = buf;
+        q->off = off;
+        q->bytes += buf->len - off;
+        return 0;
+}
+
+//한계를 넘었을 때 정책 적용 (c->lock 안에서 호출)
+//0 = 큐에 넣어도 됨, 1 = 처리 끝 (교체했거나 버림), -1 = 연결 종료
+static int apply_policy(struct conn *c, struct msgbuf *buf) {
+        struct outq *q = &c->outq;
+
+        switch(conf.bp_policy) {
+        case BP_COALESCE:
+                if(buf->kind == MSG_STATE && outq_coalesce(q, buf)) {
+                        c->bp.coalesce++;
+                        __atomic_add_fetch(&bp_total.coalesce, 1, __ATOMIC_RELAXED);
+                        return 1;
+                }
+                //교체할 게 없으면 drop과 같이 처리
+        case BP_DROP:
+                while(outq_over(q, 1, buf->len) && outq_drop_oldest(q)) {
+                        c->bp.drop++;
+                        __atomic_add_fetch(&bp_total.drop, 1, __ATOMIC_RELAXED);
+                }
+                if(!outq_over(q, 1, buf->len)) {
+                        return 0;
+                }
+                //남은 게 전부 중요 메시지면 새 메시지를 버리고, 새 메시지도 중요하면 종료
+                if(buf->kind != MSG_CRITICAL) {
+                        c->bp.drop++;
+                        __atomic_add_fetch(&bp_total.drop, 1, __ATOMIC_RELAXED);
+                        return 1;
+                }
+                break;
+        }
+
+        c->bp.disconnect++;
+        __atomic_add_fetch(&bp_total.disconnect, 1, __ATOMIC_RELAXED);
+        LOG(LOG_WARN, EV_KICK, c->id, 0, 0);
+        return -1;
+}
+
+//한계와 정책을 적용해서 큐에 추가 (c->lock 안에서 호출), 메모리가 모자라면 -1
+static int outq_add(struct conn *c, struct msgbuf *buf) {
+        struct outq *q = &c->outq;
+        int ret = 0;
+
+        if(outq_over(q, 1, buf->len)) {
+                ret = apply_policy(c, buf);
+        }
+        if(ret == -1) {
+                c->kill = 1;
+        } else if(ret == 0) {
+                //비어 있던 큐면 송신 지연은 지금부터 잼
+                if(q->head == q->tail) {
+                        c->last_tx = tick_now;
+                }
+                return outq_push(q, buf);
+        }
+        return 0;
+}
+
+//큐에 메시지 참조만 추가, 실제 전송은 소유 리액터가 함
+void conn_enqueue(struct conn *c, struct msgbuf *buf) {
+        int sched = 0;
+
+        LOCK(&c->lock);
+        if(c->closed || c->kill) {
+                UNLOCK(&c->lock);
+                return;
+        }
+        if(outq_add(c, buf) == -1) {
+                UNLOCK(&c->lock);
+                return;
+        }
+        if(!c->scheduled) {
+                c->scheduled = 1;
+                sched = 1;
+        }
+        UNLOCK(&c->lock);
+
+        if(sched) {
+                flushq_push(c->fq, c);
+        }
+}
+
+//순번 s가 게시되었는지
+static int bring_ready(uint64_t s) {
+        return __atomic_load_n(&bring[s & bring_mask].seq, __ATOMIC_ACQUIRE) == s;
+}
+
+//보낸 연결에게 돌려줄 필요 없는 슬롯은 길이 0으로 취급
+static int bslot_len(struct conn *c, struct bslot *slot) {
+        return slot->key == c->id ? 0 : slot->len;
+}
+
+//링에서 보낼 메시지를 iovec으로 채움 (c->lock 안에서 호출)
+//자기가 보낸 메시지는 건너뛰되 c->bbusy에는 포함해서 전송이 끝나면 같이 지나감
+static int bring_fill(struct conn *c, struct iovec *iov, int max, int *more) {
+        struct bslot *slot;
+        uint64_t s;
+        int n = 0;
+
+        //앞쪽의 자기 메시지는 바로 지나감 (보내다 만 메시지가 있으면 그게 맨 앞)
+        while(c->boff == 0 && bring_ready(c->bcur) && bring[c->bcur & bring_mask].key == c->id) {
+                __atomic_store_n(&c->bcur, c->bcur + 1, __ATOMIC_RELAXED);
+        }
+        for(s = c->bcur ; n < max && bring_ready(s) ; s++) {
+                slot = &bring[s & bring_mask];
+                if(slot->key == c->id) {
+                        continue;
+                }
+                iov[n].iov_base = slot->big != NULL ? slot->big->data : slot->data;
+                iov[n].iov_len = slot->len;
+                n++;
+        }
+        if(n > 0) {
+                iov[0].iov_base = (char *)iov[0].iov_base + c->boff;
+                iov[0].iov_len -= c->boff;
+        }
+        c->bbusy = n > 0 ? s - c->bcur : 0;
+        *more = bring_ready(s);
+        return n;
+}
+
+//메시지 하나를 다 보냄, 시각은 처음 필요할 때 한 번만 읽음
+static void sent_one(unsigned id, uint64_t ts, uint64_t *now) {
+        TRACE2(serv, deliver, id, ts);
+        metric_add(M_MSGS_OUT, 1);
+        if(ts != 0) {
+                if(*now == 0) {
+                        *now = metric_ns();
+                }
+                metric_hist(H_LATENCY, *now - ts);
+        }
+}
+
+//링에서 n 바이트 전송 완료 처리 (c->lock 안에서 호출)
+static void bring_consume(struct conn *c, int n, uint64_t *now) {
+        struct bslot *slot;
+        int len;
+
+        for( ; c->bbusy > 0 ; c->bbusy--) {
+                slot = &bring[c->bcur & bring_mask];
+                len = bslot_len(c, slot);
+                if(n < len - c->boff) {
+                        c->boff += n;
+                        break;
+                }
+                n -= len - c->boff;
+                c->boff = 0;
+                __atomic_store_n(&c->bcur, c->bcur + 1, __ATOMIC_RELAXED);
+                if(len > 0) {
+                        c->st.msgs_out++;
+                        sent_one(c->id, slot->ts, now);
+                }
+        }
+        c->bbusy = 0;
+}
+
+//보낼 메시지를 iovec으로 채움 (소유 스레드만 호출, 큐 앞쪽은 다른 스레드가 건드리지 않음)
+//max개를 넘어서 더 남아 있으면 *more = 1
+//링 메시지를 보내다 말았으면 그것부터, 아니면 송신 큐를 먼저 비우고 링을 읽음
+int outq_fill(struct conn *c, struct iovec *iov, int max, int *more) {
+        struct outq *q = &c->outq;
+        struct msgbuf *buf;
+        unsigned i;
+        int n = 0;
+
+        LOCK(&c->lock);
+        if(bring != NULL && (c->boff > 0 || q->head == q->tail)) {
+                n = bring_fill(c, iov, max, more);
+        } else {
+                for(i = q->head ; i != q->tail && n < max ; i++, n++) {
+                        buf = q->ring[i & (q->cap - 1)];
+                        iov[n].iov_base = buf->data;
+                        iov[n].iov_len = buf->len;
+                }
+                if(n > 0) {
+                        iov[0].iov_base = (char *)iov[0].iov_base + q->off;
+                        iov[0].iov_len -= q->off;
+                }
+                q->busy = n;
+                *more = i != q->tail || (bring != NULL && bring_ready(c->bcur));
+        }
+        if(n > 0) {
+                c->st.flushes++;
+        }
+        UNLOCK(&c->lock);
+        return n;
+}
+
+//n 바이트 전송 완료 처리, 큐가 비었으면 1 반환
+int outq_consume(struct conn *c, int n) {
+        struct outq *q = &c->outq;
+        struct msgbuf *buf;
+        uint64_t now = 0;
+        int empty;
+
+        LOCK(&c->lock);
+        q->busy = 0;
+        if(n > 0) {
+                c->last_tx = tick_now;
+                metric_add(M_BYTES_OUT, n);
+                TRACE2(serv, write, c->id, n);
+        }
+        c->st.bytes_out += n;
+        if(c->bbusy > 0) {
+                bring_consume(c, n, &now);
+                n = 0;
+        }
+        q->bytes -= n;
+        while(n > 0) {
+                buf = q->ring[q->head & (q->cap - 1)];
+                if(n < buf->len - q->off) {
+                        q->off += n;
+                        break;
+                }
+                n -= buf->len - q->off;
+                q->off = 0;
+                q->head++;
+                c->st.msgs_out++;
+                sent_one(c->id, buf->ts, &now);
+                msgbuf_put(buf);
+        }
+        empty = q->head == q->tail && (bring == NULL || !bring_ready(c->bcur));
+        UNLOCK(&c->lock);
+        return empty;
+}
+
+//큐에 쌓인 메시지를 conf.batch개씩 묶어서 보냄 : 0 = 다 보냄, 1 = EAGAIN (EPOLLOUT 대기), -1 = 에러
+//한 번에 다 못 보내면 MSG_MORE로 보내서 커널이 세그먼트를 채운 뒤 내보내게 함 (TCP_CORK와 같은 효과)
+int conn_flush(struct conn *c) {
+        struct iovec iov[IOV_BATCH];
+        struct msghdr mh;
+        int n, len, more;
+
+        memset(&mh, 0, sizeof(mh));
+        mh.msg_iov = iov;
+        while(1) {
+                n = outq_fill(c, iov, conf.batch, &more);
+                if(n == 0) {
+                        return 0;
+                }
+                //공유 메모리 연결은 링에 복사, 가득 차면 상대가 읽은 뒤 wake_fd로 깨워줌
+                if(c->shm != NULL) {
+                        len = shm_writev(c->shm, iov, n);
+                        if(len <= 0) {
+                                outq_consume(c, 0);
+                                return len == 0 ? 1 : -1;
+                        }
+                        if(outq_consume(c, len)) {
+                                return 0;
+                        }
+                        continue;
+                }
+                mh.msg_iovlen = n;
+                len = sendmsg(c->fd, &mh, more ? MSG_MORE | MSG_NOSIGNAL : MSG_NOSIGNAL);
+                if(len == -1) {
+                        //보낸 게 없으므로 전송 중 표시만 해제
+                        outq_consume(c, 0);
+                        if(errno == EINTR) {
+                                continue;
+                        }
+                        return errno == EAGAIN ? 1 : -1;
+                }
+                if(outq_consume(c, len)) {
+                        return 0;
+                }
+        }
+}
+
+//텍스트 메시지 종류 구분
+//프레임 타입으로 송신 큐 처리 방식 결정
+static int msg_kind(int type) {
+        if(type == FT_READY) {
+                return MSG_STATE;
+        }
+        if(type == FT_RESULT) {
+                return MSG_CRITICAL;
+        }
+        return MSG_NORMAL;
+}
+
+//보낸 연결은 제외
+static void enqueue_one(struct conn *c, void *arg) {
+        struct msgbuf *buf = (struct msgbuf *)arg;
+
+        if(c->id != buf->key) {
+                conn_enqueue(c, buf);
+        }
+}
+
+//보낸 연결의 통계와 플레이어 상태 갱신
+//READY <이름> <난이도> <준비> <점수> / RESULT <이름> <점수> <종료>
+void conn_on_msg(struct conn *c, struct frame *f, int kind) {
+        struct player *p = &c->player;
+        struct proto_ready *rd;
+        struct proto_result *rs;
+
+        c->st.msgs_in++;
+        c->st.bytes_in += f->raw_len;
+        if(kind == MSG_STATE && (rd = proto_ready_dec(f->data, f->len)) != NULL) {
+                p->id = proto32(rd->hdr.player);
+                //로그인한 연결은 등록한 이름을 유지
+                if(!p->login) {
+                        memcpy(p->name, rd->name, rd->name_len);
+                        p->name[rd->name_len] = 0;
+                }
+                p->difficulty = rd->difficulty;
+                p->ready = rd->ready;
+                p->score = proto16(rd->score);
+        } else if(kind == MSG_CRITICAL && (rs = proto_result_dec(f->data, f->len)) != NULL) {
+                p->id = proto32(rs->hdr.player);
+                p->score = proto16(rs->score);
+                p->end = rs->end;
+        }
+}
+
+//링 슬롯 수 (2의 거듭제곱), 리액터를 띄우기 전에 호출
+void bring_init(int slots) {
+        bring = calloc(slots, sizeof(struct bslot));
+        if(bring == NULL) {
+                error_handling("calloc() error");
+        }
+        bring_mask = slots - 1;
+}
+
+//아직 안 보낸 링 메시지를 송신 큐로 복사하고 읽기 위치를 게시된 끝으로 옮김 (c->lock 안에서 호출)
+//복사할 때 송신 큐 한계와 정책이 적용되므로 밀린 연결만 메시지를 잃음
+static void bring_spill(struct conn *c) {
+        struct bslot *slot;
+        struct msgbuf *buf;
+        uint64_t s;
+        long n = 0;
+
+        for(s = c->bcur ; bring_ready(s) ; s++) {
+                slot = &bring[s & bring_mask];
+                if(bslot_len(c, slot) == 0) {
+                        continue;
+                }
+                if(slot->big != NULL) {
+                        buf = slot->big;
+                        msgbuf_hold(buf);
+                } else {
+                        buf = msgbuf_new(slot->data, slot->len);
+                        if(buf == NULL) {
+                                continue;
+                        }
+                        buf->kind = slot->kind;
+                        buf->key = slot->key;
+                        buf->ts = slot->ts;
+                }
+                //일부만 보낸 메시지는 나머지를 먼저 보내야 프레임이 깨지지 않음
+                if(s == c->bcur && c->boff > 0) {
+                        outq_push_front(&c->outq, buf, c->boff);
+                } else if(!c->kill) {
+                        outq_add(c, buf);
+                }
+                msgbuf_put(buf);
+                n++;
+        }
+        __atomic_store_n(&c->bcur, s, __ATOMIC_RELAXED);
+        c->boff = 0;
+        __atomic_add_fetch(&bring_spill_total, n, __ATOMIC_RELAXED);
+}
+
+struct gate_arg {
+        uint64_t min;           //지금까지 본 가장 느린 읽기 위치
+        uint64_t lag;           //이보다 뒤에 있는 연결은 송신 큐로 옮김
+};
+
+static void gate_one(struct conn *c, void *arg) {
+        struct gate_arg *g = (struct gate_arg *)arg;
+        int sched = 0;
+
+        LOCK(&c->lock);
+        //보내는 중이면 옮길 수 없으므로 다음에 다시 확인
+        if(c->bcur < g->lag && c->bbusy == 0 && !c->closed) {
+                bring_spill(c);
+                if(!c->scheduled && c->fq != NULL) {
+                        c->scheduled = 1;
+                        sched = 1;
+                }
+        }
+        if(c->bcur < g->min) {
+                g->min = c->bcur;
+        }
+        UNLOCK(&c->lock);
+
+        if(sched) {
+                flushq_push(c->fq, c);
+        }
+}
+
+//순번 s의 슬롯을 쓸 수 있을 때까지 게이트를 올림
+//한 바퀴가 찰 때만 모든 연결을 보고, 반 바퀴 넘게 밀린 연결은 송신 큐로 옮겨서 게이트에서 뺌
+static void bring_wait(uint64_t s) {
+        struct gate_arg g;
+
+        while(s - __atomic_load_n(&bring_gate, __ATOMIC_ACQUIRE) > bring_mask) {
+                LOCK(&gate_lock);
+                if(s - bring_gate > bring_mask) {
+                        g.min = s;
+                        g.lag = s - (bring_mask + 1) / 2;
+                        conn_foreach(gate_one, &g);
+                        __atomic_store_n(&bring_gate, g.min, __ATOMIC_RELEASE);
+                }
+                UNLOCK(&gate_lock);
+                //링에서 보내는 중인 연결이 있으면 끝날 때까지 양보
+                if(s - __atomic_load_n(&bring_gate, __ATOMIC_ACQUIRE) > bring_mask) {
+                        __atomic_add_fetch(&bring_wait_total, 1, __ATOMIC_RELAXED);
+                        sched_yield();
+                }
+        }
+}
+
+//프레임을 링에 한 번 쓰고 리액터마다 한 번씩 깨움
+static void bring_publish(struct frame *f, int kind, unsigned key, uint64_t ts) {
+        uint64_t s = __atomic_fetch_add(&bring_next, 1, __ATOMIC_RELAXED), one = 1;
+        struct bslot *slot = &bring[s & bring_mask];
+        struct flushq *fq;
+
+        bring_wait(s);
+        if(slot->big != NULL) {
+                msgbuf_put(slot->big);
+                slot->big = NULL;
+        }
+        slot->len = f->raw_len;
+        slot->kind = kind;
+        slot->key = key;
+        slot->ts = ts;
+        if(f->raw_len <= BSLOT_DATA) {
+                memcpy(slot->data, f->raw, f->raw_len);
+        } else {
+                slot->big = msgbuf_new(f->raw, f->raw_len);
+                if(slot->big != NULL) {
+                        slot->big->kind = kind;
+                        slot->big->key = key;
+                        slot->big->ts = ts;
+                } else {
+                        //순번은 이미 받았으므로 빈 메시지로 게시 (읽는 쪽은 건너뜀)
+                        slot->len = 0;
+                }
+        }
+        __atomic_store_n(&slot->seq, s, __ATOMIC_RELEASE);
+
+        for(fq = fq_all ; fq != NULL ; fq = fq->all_next) {
+                if(__atomic_load_n(&fq->cnt, __ATOMIC_RELAXED) == 0 || __atomic_load_n(&fq->bwake, __ATOMIC_RELAXED)) {
+                        continue;
+                }
+                //소유 스레드는 루프 끝에서 확인하므로 깨울 필요 없음
+                if(!__atomic_exchange_n(&fq->bwake, 1, __ATOMIC_ACQ_REL) && !pthread_equal(pthread_self(), __atomic_load_n(&fq->owner, __ATOMIC_ACQUIRE))) {
+                        write(fq->efd, &one, sizeof(one));
+                }
+        }
+}
+
+//헤더를 포함한 프레임 그대로 보낸 연결을 뺀 모든 연결에 전달
+//링이 있으면 한 번만 쓰고, 없으면 연결마다 송신 큐에 참조를 넣음
+//READY/RESULT의 플레이어 ID는 보낸 연결의 세션 ID로 덮어씀 (클라이언트가 정한 값은 믿지 않음)
+void broadcast(struct conn *from, struct frame *f) {
+        struct msgbuf *buf;
+        int kind = msg_kind(f->type);
+        uint64_t ts = metric_ns();
+
+        TRACE3(serv, fanout_start, from->id, f->type, ts);
+        proto_stamp(f->type, f->data, f->len, from->id);
+        conn_on_msg(from, f, kind);
+        metric_add(M_RELAY, 1);
+        metric_hist(H_FANOUT, conn_count() - 1);
+        if(bring != NULL) {
+                bring_publish(f, kind, from->id, ts);
+                TRACE2(serv, fanout_end, from->id, conn_count() - 1);
+                LOG(LOG_INFO, EV_RELAY, from->id, f->type, f->len);
+                return;
+        }
+
+        buf = msgbuf_new(f->raw, f->raw_len);
+        if(buf == NULL) {
+                return;
+        }
+        buf->kind = kind;
+        buf->key = from->id;
+        buf->ts = ts;
+
+        conn_foreach(enqueue_one, buf);
+        TRACE2(serv, fanout_end, from->id, conn_count() - 1);
+
+        LOG(LOG_INFO, EV_RELAY, from->id, f->type, f->len);
+        msgbuf_put(buf);
+}
+
+//now까지 쌓인 토큰을 채움 (rate가 초당이므로 1ms에 rate/1000 토큰 = rate 단위)
+static void bucket_refill(struct bucket *b, struct rl_conf *rc, long now) {
+        long cap = rc->burst * 1000;
+
+        if(now > b->last) {
+                b->tokens += (now - b->last) * rc->rate;
+                if(b->tokens > cap) {
+                        b->tokens = cap;
+                }
+                b->last = now;
+        }
+}
+
+//수신 속도 제한 (브로드캐스트 전에 호출) : 통과하면 0, 버리면 1, 연결을 끊어야 하면 -1
+//걸리는 버킷이 모두 충분할 때만 한꺼번에 차감
+int conn_limit(struct conn *c, struct frame *f, long now) {
+        int idx[3], n = 0, i;
+        long cost[3], need;
+        struct rl_conf *rc;
+
+        idx[n] = RL_ALL;
+        cost[n++] = 1000;
+        idx[n] = RL_BYTES;
+        cost[n++] = f->raw_len * 1000L;
+        if(f->type <= FT_RESULT) {
+                idx[n] = RL_TEXT + f->type;
+                cost[n++] = 1000;
+        }
+
+        for(i = 0 ; i < n ; i++) {
+                rc = &conf.rl[idx[i]];
+                if(rc->rate <= 0) {
+                        continue;
+                }
+                bucket_refill(&c->rl[idx[i]], rc, now);
+                //버킷보다 큰 프레임은 가득 찼을 때 통과시키고 빚으로 남김
+                need = cost[i] < rc->burst * 1000 ? cost[i] : rc->burst * 1000;
+                if(c->rl[idx[i]].tokens < need) {
+                        break;
+                }
+        }
+        if(i == n) {
+                for(i = 0 ; i < n ; i++) {
+                        if(conf.rl[idx[i]].rate > 0) {
+                                c->rl[idx[i]].tokens -= cost[i];
+                        }
+                }
+                return 0;
+        }
+
+        c->st.limited++;
+        if(conf.rl_action == RL_KICK) {
+                __atomic_add_fetch(&rl_kick_total, 1, __ATOMIC_RELAXED);
+                LOG(LOG_WARN, EV_LIMIT, c->id, f->type, 1);
+                return -1;
+        }
+        __atomic_add_fetch(&rl_drop_total, 1, __ATOMIC_RELAXED);
+        LOG(LOG_DEBUG, EV_LIMIT, c->id, f->type, 0);
+        return 1;
+}
+
+//스레드 모드 소켓 쓰기 : 프레임 하나를 통째로 씀 (소유 스레드의 응답과 다른 스레드의 중계가 섞이지 않게)
+//블로킹 쓰기라서 c->lock 같은 다른 잠금을 잡은 채로 부르지 말 것
+int conn_write(struct conn *c, char *data, int len) {
+        int ret = -1;
+
+        LOCK(&c->wlock);
+        //conn_fanout은 닫힌 연결에도 부를 수 있음 (fd는 wlock 안에서 닫힘)
+        if(!__atomic_load_n(&c->closed, __ATOMIC_ACQUIRE)) {
+                ret = write_full(c->fd, data, len);
+        }
+        UNLOCK(&c->wlock);
+        return ret;
+}
+
+//스레드 모드 conn_send : c->lock을 놓고 wlock만 잡은 채로 씀 (wlock을 잡고 있으면 소켓이 닫히지 않음)
+static int send_direct(struct conn *c, unsigned id, struct msgbuf *buf) {
+        uint64_t now = 0;
+        int ret = -1;
+
+        LOCK(&c->wlock);
+        //lock을 놓은 사이에 닫혔을 수 있음
+        if(__atomic_load_n(&c->id, __ATOMIC_RELAXED) == id && !__atomic_load_n(&c->closed, __ATOMIC_RELAXED)) {
+                ret = write_full(c->fd, buf->data, buf->len) == -1 ? -1 : 0;
+        }
+        UNLOCK(&c->wlock);
+        if(ret == 0) {
+                metric_add(M_BYTES_OUT, buf->len);
+                TRACE2(serv, write, id, buf->len);
+                sent_one(id, buf->ts, &now);
+        }
+        conn_put(c);
+        return ret;
+}
+
+//id 연결 하나에만 보냄, 이미 닫혔거나 없는 id면 -1
+//스레드 모드 연결은 송신 큐가 없으므로 바로 씀 (블로킹 쓰기라서 c->lock 밖에서)
+int conn_send(unsigned id, struct msgbuf *buf) {
+        struct conn *c = conn_by_id(id);
+        int sched = 0, ret = 0;
+
+        if(c == NULL) {
+                return -1;
+        }
+        LOCK(&c->lock);
+        //찾은 뒤에 닫히고 다른 연결로 재사용됐을 수 있음
+        if(c->id != id || c->closed || c->kill) {
+                UNLOCK(&c->lock);
+                return -1;
+        }
+        if(c->fq == NULL) {
+                conn_hold(c);
+                UNLOCK(&c->lock);
+                return send_direct(c, id, buf);
+        }
+        if(outq_add(c, buf) == -1) {
+                ret = -1;
+        } else if(!c->scheduled) {
+                c->scheduled = 1;
+                sched = 1;
+        }
+        UNLOCK(&c->lock);
+
+        if(sched) {
+                flushq_push(c->fq, c);
+        }
+        return ret;
+}
+
+//ids 연결들에만 보냄, 보낸 연결 수 반환
+int conn_multicast(unsigned *ids, int n, struct msgbuf *buf) {
+        int i, sent = 0;
+
+        for(i = 0 ; i < n ; i++) {
+                if(conn_send(ids[i], buf) == 0) {
+                        sent++;
+                }
+        }
+        return sent;
+}
+
+//관리 콘솔의 강제 종료 : 표시하고 소켓을 shutdown, 소유 스레드가 EOF를 보고 닫음, 없는 id면 -1
+//conn_close는 lock 안에서 closed를 세운 뒤에 fd를 닫으므로 lock을 잡고 확인하면 fd와 슬롯이 아직 이 연결의 것
+int conn_kick(unsigned id) {
+        struct conn *c = conn_by_id(id);
+
+        if(c == NULL) {
+                return -1;
+        }
+        LOCK(&c->lock);
+        if(c->id != id || c->closed || c->kill) {
+                UNLOCK(&c->lock);
+                return -1;
+        }
+        __atomic_store_n(&c->kill, 1, __ATOMIC_RELEASE);
+        shutdown(c->fd, SHUT_RDWR);
+        UNLOCK(&c->lock);
+        LOG(LOG_WARN, EV_KICK, id, 1, 0);
+        return 0;
+}
+
+//FT_LOGIN 요청 처리, out에 응답 프레임을 쓰고 길이 반환
+//out은 FRAME_HDR_MAX + sizeof(struct proto_login_ack) 이상
+int conn_login(struct conn *c, struct frame *f, char *out) {
+        struct proto_login *m = proto_login_dec(f->data, f->len);
+        struct player *p = &c->player;
+        char name[NAME_SIZE];
+        int ok = 0, n;
+
+        if(m != NULL) {
+                memcpy(name, m->name, m->name_len);
+                name[m->name_len] = 0;
+                ok = (p->login && !strcmp(p->name, name)) || name_claim(name, c->id) == 0;
+        }
+        //이름을 바꾸면 예전 이름은 풀어줌
+        if(ok && !(p->login && !strcmp(p->name, name))) {
+                if(p->login) {
+                        name_release(p->name, c->id);
+                }
+                strcpy(p->name, name);
+                p->login = 1;
+        }
+        LOG(LOG_INFO, EV_LOGIN, c->id, ok, name_count());
+        n = frame_hdr(out, FT_LOGIN, sizeof(struct proto_login_ack));
+        n += proto_login_ack_enc(out + n, ok, c->id);
+        return n;
+}
+
+//FT_DIRECT 처리 : 안쪽 프레임으로 바꿔서 대상에게만 보냄, 잘못된 요청이면 -1
+//대상 목록 자리에 새 프레임 헤더를 써서 페이로드를 복사하지 않고 msgbuf를 만듦
+int conn_direct(struct conn *c, struct frame *f) {
+        struct proto_direct *m = proto_direct_dec(f->data, f->len);
+        unsigned to[PROTO_DIRECT_MAX];
+        char hdr[FRAME_HDR_MAX];
+        struct msgbuf *buf;
+        char *data;
+        unsigned len;
+        int i, hlen;
+
+        if(m == NULL || (m->type != FT_TEXT && m->type != FT_READY && m->type != FT_RESULT)) {
+                return -1;
+        }
+        for(i = 0 ; i < m->n_to ; i++) {
+                to[i] = proto32(m->to[i]);
+        }
+        data = f->data + sizeof(*m) + sizeof(uint32_t) * m->n_to;
+        len = f->len - (data - f->data);
+        proto_stamp(m->type, data, len, c->id);
+
+        //대상 목록은 최소 7바이트라서 헤더(최대 6바이트)가 항상 들어감
+        hlen = frame_hdr(hdr, m->type, len);
+        memcpy(data - hlen, hdr, hlen);
+        buf = msgbuf_new(data - hlen, hlen + len);
+        if(buf == NULL) {
+                return 0;
+        }
+        buf->kind = msg_kind(m->type);
+        buf->key = c->id;
+        buf->ts = metric_ns();
+        TRACE3(serv, fanout_start, c->id, m->type, buf->ts);
+        i = conn_multicast(to, m->n_to, buf);
+        TRACE2(serv, fanout_end, c->id, i);
+        metric_add(M_RELAY, 1);
+        metric_hist(H_FANOUT, i);
+        LOG(LOG_INFO, EV_DIRECT, c->id, m->type, i);
+        msgbuf_put(buf);
+        return 0;
+}
+
+//접속 직후 세션 ID를 알려줌 (송신 큐를 쓰는 모드, 핫 리스타트로 넘겨받은 연결은 새 ID)
+void conn_hello(struct conn *c) {
+        char data[FRAME_HDR_MAX + sizeof(struct proto_hello)];
+        int n;
+
+        n = frame_hdr(data, FT_HELLO, sizeof(struct proto_hello));
+        n += proto_hello_enc(data + n, c->id);
+        conn_reply(c, data, n);
+}
+
+//이 연결에만 보내는 제어 프레임 (복사해서 큐에 넣음)
+static void conn_reply(struct conn *c, char *data, int len) {
+        struct msgbuf *buf = msgbuf_new(data, len);
+
+        if(buf == NULL) {
+                return;
+        }
+        buf->kind = MSG_CRITICAL;
+        conn_enqueue(c, buf);
+        msgbuf_put(buf);
+}
+
+//FT_SHM 요청 처리 (소유 스레드에서 호출) : 0 = 전환함, 1 = 거절 응답, -1 = 연결을 닫아야 함
+//전환하면 호출한 쪽이 c->shm->wake_fd를 감시해야 함, allow가 0이면 항상 거절
+int conn_shm(struct conn *c, int allow) {
+        char buf[FRAME_HDR_MAX + sizeof(struct proto_shm)];
+        char ctl[CMSG_SPACE(sizeof(int) * 3)];
+        struct shm_end *e;
+        struct conn **slot;
+        struct cmsghdr *cm;
+        struct msghdr mh;
+        struct iovec iov;
+        int fds[3], n;
+
+        c->shm_req = 0;
+        //보내다 만 메시지가 있으면 나머지도 소켓으로 보내야 하므로 거절
+        LOCK(&c->lock);
+        allow = allow && c->outq.off == 0 && c->outq.busy == 0;
+        UNLOCK(&c->lock);
+        e = NULL;
+        if(allow && c->peer.sin_family == AF_UNIX && c->shm == NULL && shm_create(&fds[0], &fds[1], &fds[2]) == 0) {
+                e = malloc(sizeof(*e));
+                if(e == NULL || shm_attach(e, fds[0], fds[1], fds[2], SHM_SERVER) == -1) {
+                        free(e);
+                        e = NULL;
+                        close(fds[0]);
+                        close(fds[1]);
+                        close(fds[2]);
+                }
+        }
+        if(e == NULL) {
+                conn_enqueue(c, shm_no_buf);
+                return 1;
+        }
+
+        //응답 프레임과 같이 memfd, 서버 eventfd, 클라이언트 eventfd를 넘김
+        n = frame_hdr(buf, FT_SHM, sizeof(struct proto_shm));
+        n += proto_shm_enc(buf + n, 1, SHM_RING_SIZE);
+        memset(&mh, 0, sizeof(mh));
+        memset(ctl, 0, sizeof(ctl));
+        iov.iov_base = buf;
+        iov.iov_len = n;
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = ctl;
+        mh.msg_controllen = sizeof(ctl);
+        cm = CMSG_FIRSTHDR(&mh);
+        cm->cmsg_level = SOL_SOCKET;
+        cm->cmsg_type = SCM_RIGHTS;
+        cm->cmsg_len = CMSG_LEN(sizeof(fds));
+        memcpy(CMSG_DATA(cm), fds, sizeof(fds));
+        slot = tab_slot(e->wake_fd, 1);
+        if(slot == NULL || sendmsg(c->fd, &mh, MSG_NOSIGNAL | MSG_DONTWAIT) != n) {
+                close(fds[0]);
+                shm_detach(e);
+                free(e);
+                return -1;
+        }
+        //매핑은 남아 있으므로 memfd는 닫음, 클라이언트 eventfd는 깨울 때 필요
+        close(fds[0]);
+        __atomic_store_n(slot, c, __ATOMIC_RELEASE);
+        c->shm = e;
+        return 0;
+}
+
+//accept 직후 호출, 받아도 되면 0 아니면 다시 시도할 때까지 ms (reason에 이유)
+//live는 지금 연결 수 (accept 프로세스는 워커들의 합)
+long conn_admit(long live, int *reason) {
+        struct rl_conf rc = { conf.accept_rate, conf.accept_rate };
+        long now, wait = 0;
+
+        if(conf.max_conn > 0 && live >= conf.max_conn) {
+                *reason = BUSY_FULL;
+                __atomic_add_fetch(&busy_total[BUSY_FULL], 1, __ATOMIC_RELAXED);
+                return ADMIT_RETRY_MS;
+        }
+        if(rc.rate <= 0) {
+                return 0;
+        }
+
+        LOCK(&admit_lock);
+        now = now_ms();
+        if(admit_bucket.last == 0) {
+                admit_bucket.tokens = rc.burst * 1000;
+                admit_bucket.last = now;
+        }
+        bucket_refill(&admit_bucket, &rc, now);
+        if(admit_bucket.tokens >= 1000) {
+                admit_bucket.tokens -= 1000;
+        } else {
+                //토큰 1개가 찰 때까지
+                wait = (1000 - admit_bucket.tokens + rc.rate - 1) / rc.rate;
+        }
+        UNLOCK(&admit_lock);
+
+        if(wait == 0) {
+                return 0;
+        }
+        *reason = BUSY_RATE;
+        __atomic_add_fetch(&busy_total[BUSY_RATE], 1, __ATOMIC_RELAXED);
+        return wait;
+}
+
+//거절한 연결에 BUSY 프레임을 보내고 닫음 (새 소켓이라 송신 버퍼는 비어 있음)
+void conn_reject(int fd, struct sockaddr_in *peer, int reason, long retry_ms) {
+        char buf[FRAME_HDR_MAX + sizeof(struct proto_busy)];
+        int n;
+
+        n = frame_hdr(buf, FT_BUSY, sizeof(struct proto_busy));
+        n += proto_busy_enc(buf + n, reason, retry_ms);
+        send(fd, buf, n, MSG_DONTWAIT | MSG_NOSIGNAL);
+        close(fd);
+        LOG(LOG_DEBUG, EV_BUSY, peer->sin_addr.s_addr, reason, retry_ms);
+}
+
+void admit_dump(FILE *fp) {
+        fprintf(fp, "admission : busy full %ld, busy rate %ld\n",
+                __atomic_load_n(&busy_total[BUSY_FULL], __ATOMIC_RELAXED),
+                __atomic_load_n(&busy_total[BUSY_RATE], __ATOMIC_RELAXED));
+}
+
+//소유 리액터의 휠에 하트비트 타이머를 검 (리액터 스레드에서 호출)
+void conn_watch(struct conn *c, struct wheel *w) {
+        if(conf.hb_idle <= 0) {
+                return;
+        }
+        c->wheel = w;
+        c->last_rx = c->last_tx = c->ping_at = w->now;
+        c->tm.fn = conn_on_timer;
+        timer_add(w, &c->tm, conf.hb_idle);
+}
+
+//하트비트 타이머 : 조용하면 PING, 너무 오래 조용하거나 송신이 막혀 있으면 닫기 예약
+static void conn_on_timer(struct timer *t) {
+        struct conn *c = (struct conn *)((char *)t - offsetof(struct conn, tm));
+        long now = c->wheel->now, next;
+        int stalled, sched = 0;
+
+        if(c->closed || c->kill) {
+                return;
+        }
+        LOCK(&c->lock);
+        stalled = c->outq.head != c->outq.tail && now - c->last_tx >= conf.hb_timeout;
+        UNLOCK(&c->lock);
+
+        if(stalled || now - c->last_rx >= conf.hb_timeout) {
+                LOG(LOG_WARN, EV_TIMEOUT, c->id, now - c->last_rx, stalled);
+                //실제로 닫는 건 flush 단계 (io_uring은 진행 중인 요청을 먼저 끝내야 함)
+                LOCK(&c->lock);
+                c->kill = 1;
+                if(!c->scheduled) {
+                        c->scheduled = 1;
+                        sched = 1;
+                }
+                UNLOCK(&c->lock);
+                if(sched) {
+                        flushq_push(c->fq, c);
+                }
+                return;
+        }
+
+        //마지막 수신 뒤로 PING을 안 보냈으면 보냄
+        if(now - c->last_rx >= conf.hb_idle && c->ping_at <= c->last_rx) {
+                c->ping_at = now;
+                conn_enqueue(c, ping_buf);
+        }
+
+        //다음 확인 시각 : PING 보낼 때, 수신 시간 초과, 송신 시간 초과 중 가장 빠른 것
+        next = c->ping_at <= c->last_rx ? c->last_rx + conf.hb_idle : c->last_rx + conf.hb_timeout;
+        LOCK(&c->lock);
+        if(c->outq.head != c->outq.tail && c->last_tx + conf.hb_timeout < next) {
+                next = c->last_tx + conf.hb_timeout;
+        }
+        UNLOCK(&c->lock);
+        timer_add(c->wheel, t, next > now ? next - now : WHEEL_TICK_MS);
+}
+
+//제어 프레임은 여기서 처리하고 나머지는 전달, 속도 제한으로 끊어야 하면 -1
+static int dispatch(struct conn *c, struct frame *f) {
+        char ack[FRAME_HDR_MAX + sizeof(struct proto_login_ack)];
+        int lim = conn_limit(c, f, tick_now);
+
+        TRACE3(serv, frame, c->id, f->type, f->len);
+        metric_add(M_MSGS_IN, 1);
+        metric_add(M_BYTES_IN, f->raw_len);
+        if(lim != 0) {
+                c->st.msgs_in++;
+                return lim == -1 ? -1 : 0;
+        }
+        if(f->type == FT_PING) {
+                c->st.msgs_in++;
+                conn_enqueue(c, pong_buf);
+        } else if(f->type == FT_PONG) {
+                c->st.msgs_in++;
+        } else if(f->type == FT_SHM) {
+                //전환은 fd를 같이 보내야 해서 소유 리액터가 처리
+                c->st.msgs_in++;
+                c->shm_req = 1;
+        } else if(f->type == FT_LOGIN) {
+                c->st.msgs_in++;
+                conn_reply(c, ack, conn_login(c, f, ack));
+        } else if(f->type == FT_DIRECT) {
+                c->st.msgs_in++;
+                c->st.bytes_in += f->raw_len;
+                if(conn_direct(c, f) == -1) {
+                        LOG(LOG_WARN, EV_BADFRAME, c->id, f->type, 0);
+                }
+        } else {
+                broadcast(c, f);
+        }
+        return 0;
+}
+
+//수신 링에 쌓인 완전한 프레임을 모두 전달, 잘못된 프레임이면 -1
+int conn_drain_rx(struct conn *c) {
+        struct frame f;
+        int ret;
+
+        c->last_rx = tick_now;
+        while((ret = frame_ring_next(&c->rx, &f)) == 1) {
+                if(dispatch(c, &f) == -1) {
+                        return -1;
+                }
+        }
+        if(ret == -1) {
+                LOG(LOG_WARN, EV_BADFRAME, c->id, 0, 0);
+        }
+        return ret;
+}
+
+//이미 받은 데이터를 처리 (io_uring 제공 버퍼)
+//수신 링이 비어 있으면 버퍼에서 바로 프레임을 꺼내고 남은 조각만 링에 복사
+int conn_feed(struct conn *c, char *data, int len) {
+        struct frame f;
+        int n;
+
+        c->last_rx = tick_now;
+        while(len > 0 && c->rx.head == c->rx.tail) {
+                n = frame_parse(data, len, &f);
+                if(n == -1) {
+                        LOG(LOG_WARN, EV_BADFRAME, c->id, 0, 0);
+                        return -1;
+                }
+                if(n == 0) {
+                        break;
+                }
+                if(dispatch(c, &f) == -1) {
+                        return -1;
+                }
+                data += n;
+                len -= n;
+        }
+        if(len > 0 && frame_ring_write(&c->rx, data, len) == -1) {
+                LOG(LOG_WARN, EV_BADFRAME, c->id, 0, 0);
+                return -1;
+        }
+        return conn_drain_rx(c);
+}
+
+static void dump_one(struct conn *c, void *arg) {
+        long *sum = (long *)arg;
+
+        LOCK(&c->lock);
+        sum[0] += c->st.msgs_out;
+        sum[1] += c->st.flushes;
+        fprintf(stderr, "  #%08x fd %d %s [%s] : in %ld, out %ld in %ld sends, queued %u msgs / %ld bytes, drop %ld, coalesce %ld, limited %ld\n",
+                c->id, c->fd, inet_ntoa(c->peer.sin_addr), c->player.name, c->st.msgs_in, c->st.msgs_out,
+                c->st.flushes, c->outq.tail - c->outq.head, c->outq.bytes, c->bp.drop, c->bp.coalesce, c->st.limited);
+        UNLOCK(&c->lock);
+}
+
+//전체 누적값 출력 (SIGUSR1 덤프와 관리 콘솔), 잠금 없이 읽음
+void conn_totals(FILE *fp) {
+        fprintf(fp, "outq policy : drop %ld, coalesce %ld, disconnect %ld (%d clients)\n",
+                __atomic_load_n(&bp_total.drop, __ATOMIC_RELAXED),
+                __atomic_load_n(&bp_total.coalesce, __ATOMIC_RELAXED),
+                __atomic_load_n(&bp_total.disconnect, __ATOMIC_RELAXED),
+                conn_count());
+        fprintf(fp, "rate limit : drop %ld, kick %ld\n",
+                __atomic_load_n(&rl_drop_total, __ATOMIC_RELAXED),
+                __atomic_load_n(&rl_kick_total, __ATOMIC_RELAXED));
+        admit_dump(fp);
+        fprintf(fp, "names : %d registered\n", name_count());
+        if(bring != NULL) {
+                fprintf(fp, "bcast ring : %lu slots, %lu published, gate %lu, spilled %ld, producer waits %ld\n",
+                        (unsigned long)bring_mask + 1, (unsigned long)__atomic_load_n(&bring_next, __ATOMIC_RELAXED) - 1,
+                        (unsigned long)__atomic_load_n(&bring_gate, __ATOMIC_RELAXED),
+                        __atomic_load_n(&bring_spill_total, __ATOMIC_RELAXED),
+                        __atomic_load_n(&bring_wait_total, __ATOMIC_RELAXED));
+        }
+}
+
+//송신 큐 정책 통계 출력 (SIGUSR1)
+void bp_dump(void) {
+        long sum[2] = { 0, 0 };     //보낸 메시지, 송신 횟수
+
+        conn_totals(stderr);
+        conn_foreach(dump_one, sum);
+        fprintf(stderr, "sends : %ld msgs in %ld sends (%.1f msgs/send)\n",
+                sum[0], sum[1], sum[1] > 0 ? (double)sum[0] / sum[1] : 0.0);
+        lock_dump();
+}
+
+void flushq_init(struct flushq *fq) {
+        pthread_mutex_init(&fq->lock, NULL);
+        fq->head = NULL;
+        fq->owner = pthread_self();
+        fq->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(fq->efd == -1) {
+                error_handling("eventfd() error");
+        }
+        fq->member = NULL;
+        fq->cnt = fq->cap = 0;
+        fq->bwake = 0;
+        fq->all_next = fq_all;
+        fq_all = fq;
+}
+
+//연결의 소유 리액터를 정함, 링이 있으면 리액터의 읽는 연결 목록에도 추가
+int flushq_add(struct flushq *fq, struct conn *c) {
+        struct conn **member;
+        int cap;
+
+        c->fq = fq;
+        if(bring == NULL) {
+                return 0;
+        }
+        LOCK(&fq->lock);
+        if(fq->cnt == fq->cap) {
+                cap = fq->cap ? fq->cap * 2 : 64;
+                member = realloc(fq->member, sizeof(struct conn *) * cap);
+                if(member == NULL) {
+                        UNLOCK(&fq->lock);
+                        return -1;
+                }
+                fq->member = member;
+                fq->cap = cap;
+        }
+        c->fq_idx = fq->cnt;
+        fq->member[fq->cnt] = c;
+        __atomic_store_n(&fq->cnt, fq->cnt + 1, __ATOMIC_RELAXED);
+        UNLOCK(&fq->lock);
+        return 0;
+}
+
+static void flushq_del(struct conn *c) {
+        struct flushq *fq = c->fq;
+        struct conn *last;
+
+        if(c->fq_idx == -1) {
+                return;
+        }
+        LOCK(&fq->lock);
+        last = fq->member[fq->cnt - 1];
+        fq->member[c->fq_idx] = last;
+        last->fq_idx = c->fq_idx;
+        __atomic_store_n(&fq->cnt, fq->cnt - 1, __ATOMIC_RELAXED);
+        UNLOCK(&fq->lock);
+        c->fq_idx = -1;
+}
+
+//flush할 연결이 있거나 링에 새 메시지가 있음 (리액터가 잠들 시간을 정할 때)
+int flushq_pending(struct flushq *fq) {
+        return __atomic_load_n(&fq->head, __ATOMIC_RELAXED) != NULL || __atomic_load_n(&fq->bwake, __ATOMIC_RELAXED);
+}
+
+//링에서 읽을 메시지가 있는 연결을 flush 목록에 올림 (소유 스레드)
+static void bring_scan(struct flushq *fq) {
+        struct conn *c;
+        int i;
+
+        LOCK(&fq->lock);
+        for(i = 0 ; i < fq->cnt ; i++) {
+                c = fq->member[i];
+                if(!bring_ready(__atomic_load_n(&c->bcur, __ATOMIC_RELAXED))) {
+                        continue;
+                }
+                LOCK(&c->lock);
+                if(!c->scheduled && !c->closed) {
+                        c->scheduled = 1;
+                        conn_hold(c);
+                        c->fq_next = fq->head;
+                        fq->head = c;
+                }
+                UNLOCK(&c->lock);
+        }
+        UNLOCK(&fq->lock);
+}
+
+//flush 대기 목록을 가져와서 연결마다 flush 호출
+void flushq_drain(struct flushq *fq, void (*flush)(struct conn *c)) {
+        struct conn *c, *next;
+
+        if(__atomic_load_n(&fq->bwake, __ATOMIC_RELAXED) && __atomic_exchange_n(&fq->bwake, 0, __ATOMIC_ACQ_REL)) {
+                bring_scan(fq);
+        }
+        LOCK(&fq->lock);
+        c = fq->head;
+        fq->head = NULL;
+        UNLOCK(&fq->lock);
+
+        for( ; c != NULL ; c = next) {
+                next = c->fq_next;
+                LOCK(&c->lock);
+                c->scheduled = 0;
+                UNLOCK(&c->lock);
+                if(!c->closed) {
+                        flush(c);
+                }
+                conn_put(c);
+        }
+}
@@ -0,0 +1,210 @@
+#ifndef CONN_H
+#define CONN_H
+
+#include "serv.h"
+#include "../common/frame.h"
+#include "../common/proto.h"
+#include "../common/shm.h"
+#include "timer.h"
+
+#include <stdio.h>
+#include <pthread.h>
+#include <time.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+#define OUTQ_INIT 16            //송신 큐 초기 크기 (2의 거듭제곱)
+#define IOV_BATCH 64            //writev 한 번에 묶는 메시지 수
+#define TAB_CHUNK 1024          //연결 테이블 할당 단위
+#define TAB_DIR 1024            //최대 fd = TAB_CHUNK * TAB_DIR
+#define N_SHARD 16              //브로드캐스트 목록 샤드 수
+#define SLAB_CHUNK 256          //연결 풀 확장 단위
+#define SLAB_DIR 4096           //최대 연결 수 = SLAB_CHUNK * SLAB_DIR
+#define ID_SLOT_BITS 20         //연결 ID 하위 비트 = 풀 슬롯, 상위 = 세대 번호
+#define ID_SLOT_MASK ((1U << ID_SLOT_BITS) - 1)
+#define NAME_SIZE 20
+#define BRING_SLOTS 4096        //브로드캐스트 링 기본 슬롯 수
+#define BRING_MIN 64
+#define BSLOT_DATA 216          //슬롯에 바로 담는 프레임 크기, 더 크면 msgbuf를 따로 만들어 가리킴
+
+//메시지 종류 (송신 큐가 넘칠 때 처리 방식이 다름)
+#define MSG_NORMAL 0            //버릴 수 있음
+#define MSG_STATE 1             //같은 key의 최신 것만 있으면 됨 (READY)
+#define MSG_CRITICAL 2          //절대 버리지 않음 (RESULT)
+
+//여러 연결의 송신 큐가 같이 참조하는 메시지 버퍼
+struct msgbuf {
+        int ref;
+        int len;
+        int kind;
+        unsigned key;           //보낸 연결 id, MSG_STATE 병합 기준
+        uint64_t ts;            //받은 시각 (ns, 전달 지연 측정), 0이면 서버가 만든 메시지
+        char data[];
+};
+
+//브로드캐스트 링 슬롯 : 메시지마다 한 번만 쓰고 연결은 읽기 위치만 따로 가짐
+//모든 연결이 지나갈 때까지 덮어쓰지 않으므로 연결은 슬롯에서 바로 보냄
+struct bslot {
+        uint64_t seq;           //마지막으로 게시된 순번, 읽는 쪽은 자기 위치와 같을 때만 읽음
+        struct msgbuf *big;     //BSLOT_DATA보다 큰 프레임, 슬롯을 다시 쓸 때 해제
+        uint64_t ts;            //받은 시각 (msgbuf와 같음)
+        int len;
+        int kind;
+        unsigned key;
+        char data[BSLOT_DATA];
+} __attribute__((aligned(64)));
+
+//연결별 송신 큐 (msgbuf 포인터 링)
+struct outq {
+        struct msgbuf **ring;
+        unsigned head, tail, cap;
+        int off;                //head 메시지에서 이미 보낸 바이트
+        int busy;               //head부터 전송 중인 메시지 수 (버리거나 교체 불가)
+        long bytes;             //큐에 남은 바이트
+};
+
+//정책별 발동 횟수
+struct bp_stats {
+        long drop;
+        long coalesce;
+        long disconnect;
+};
+
+//플레이어 상태 (READY/RESULT 메시지로 갱신)
+struct player {
+        uint32_t id;
+        char name[NAME_SIZE];
+        int difficulty;
+        int ready;
+        int score;
+        int end;
+        int login;              //name을 이름 테이블에 등록했는지 (registry.h)
+};
+
+//토큰 버킷 (단위 : 1/1000 토큰), 소유 스레드만 접근
+struct bucket {
+        long tokens;
+        long last;              //마지막으로 채운 시각 (ms)
+};
+
+//연결별 통계
+struct conn_stats {
+        long msgs_in, bytes_in;
+        long msgs_out, bytes_out;
+        long flushes;           //송신 시스템 콜 (또는 sendmsg SQE) 횟수
+        long limited;           //속도 제한에 걸린 메시지
+        time_t since;
+};
+
+//리액터(또는 링)별 flush 대기 목록, 다른 스레드가 넣으면 efd로 깨움
+struct flushq {
+        pthread_mutex_t lock;
+        struct conn *head;
+        int efd;
+        pthread_t owner;        //소유 스레드, 리액터 루프가 시작할 때 atomic으로 씀
+        //브로드캐스트 링을 읽는 연결 (이 리액터 소유), lock 안에서 변경
+        struct conn **member;
+        int cnt, cap;
+        int bwake;              //링에 새 메시지가 있음, 다음 flushq_drain에서 읽을 연결을 찾음
+        struct flushq *all_next;
+};
+
+//연결 컨텍스트, 미리 할당한 풀에서 꺼내 쓰고 돌려놓음
+//id의 세대 번호는 반환할 때마다 올라가므로 예전 id로는 다시 찾을 수 없음
+struct conn {
+        unsigned id;
+        int fd;
+        struct sockaddr_in peer;
+        int idx;                //샤드 목록에서의 위치
+        int ref;
+        int closed;             //lock 안에서 변경
+        pthread_mutex_t lock;   //outq, scheduled, closed 보호
+        pthread_mutex_t wlock;  //스레드 모드 : 소켓에 쓰는 스레드가 여럿이라 프레임이 섞이지 않게 (conn_write, conn_send), 닫을 때도 잡음
+        struct outq outq;
+        int scheduled;          //flushq에 올라가 있는지
+        int kill;               //송신 큐 초과나 kick으로 종료 요청됨 (소유 스레드가 닫음)
+        struct bp_stats bp;
+        struct flushq *fq;      //소유 리액터의 flush 목록
+        struct conn *fq_next;
+        int fq_idx;             //fq->member에서의 위치, 없으면 -1
+
+        //브로드캐스트 링 읽기 위치 (lock 안에서 변경)
+        uint64_t bcur;          //다음에 보낼 순번
+        int boff;               //bcur 메시지에서 이미 보낸 바이트
+        int bbusy;              //bcur부터 전송 중인 메시지 수, 그동안은 다른 스레드가 송신 큐로 옮기지 못함
+
+        struct player player;
+        struct conn_stats st;
+        struct frame_ring rx;   //수신 링, 풀에서 유지되며 프레임 단위로 꺼냄
+        struct bucket rl[RL_N]; //수신 속도 제한
+
+        //공유 메모리 전송 (UNIX 소켓 연결이 FT_SHM으로 전환), NULL이면 소켓으로 주고받음
+        struct shm_end *shm;
+        int shm_req;            //FT_SHM을 받음, 소유 리액터가 conn_drain_rx 뒤에 처리
+
+        //하트비트 (소유 리액터의 휠에서 확인)
+        struct timer tm;
+        struct wheel *wheel;    //NULL이면 감시 안 함 (스레드 모드)
+        long last_rx;           //마지막으로 받은 시각 (ms)
+        long last_tx;           //송신 큐가 마지막으로 줄었거나 비어 있다 채워진 시각, lock 안에서 변경
+        long ping_at;           //마지막 PING 시각
+
+        //io_uring : 진행 중인 sendmsg (소유 링만 접근)
+        int sending;
+        struct iovec iov[IOV_BATCH];
+        struct msghdr mh;
+
+        struct msgbuf *ring0[OUTQ_INIT];        //처음 송신 큐, 넘치면 malloc한 큐로 교체
+        struct conn *free_next;
+};
+
+struct msgbuf *msgbuf_new(char *data, int len);
+void msgbuf_hold(struct msgbuf *buf);
+void msgbuf_put(struct msgbuf *buf);
+
+void conn_init(int prealloc);
+struct conn *conn_new(int fd, struct flushq *fq, struct sockaddr_in *peer);
+struct conn *conn_get(int fd);
+struct conn *conn_by_id(unsigned id);
+int conn_count(void);
+void conn_foreach(void (*fn)(struct conn *c, void *arg), void *arg);
+void conn_fanout(void (*fn)(struct conn *c, void *arg), void *arg);
+void conn_scan(void (*fn)(struct conn *c, void *arg), void *arg);
+long conn_queued(struct conn *c);
+long conn_lag(struct conn *c);
+void conn_hold(struct conn *c);
+void conn_put(struct conn *c);
+void conn_close(struct conn *c);
+void conn_watch(struct conn *c, struct wheel *w);
+
+void conn_enqueue(struct conn *c, struct msgbuf *buf);
+int outq_fill(struct conn *c, struct iovec *iov, int max, int *more);
+int outq_consume(struct conn *c, int n);
+int conn_flush(struct conn *c);
+void conn_on_msg(struct conn *c, struct frame *f, int kind);
+void broadcast(struct conn *from, struct frame *f);
+void conn_hello(struct conn *c);
+int conn_write(struct conn *c, char *data, int len);
+int conn_send(unsigned id, struct msgbuf *buf);
+int conn_multicast(unsigned *ids, int n, struct msgbuf *buf);
+int conn_kick(unsigned id);
+int conn_login(struct conn *c, struct frame *f, char *out);
+int conn_direct(struct conn *c, struct frame *f);
+int conn_limit(struct conn *c, struct frame *f, long now);
+int conn_shm(struct conn *c, int allow);
+long conn_admit(long live, int *reason);
+void conn_reject(int fd, struct sockaddr_in *peer, int reason, long retry_ms);
+void admit_dump(FILE *fp);
+int conn_drain_rx(struct conn *c);
+int conn_feed(struct conn *c, char *data, int len);
+void conn_totals(FILE *fp);
+void bp_dump(void);
+
+void flushq_init(struct flushq *fq);
+int flushq_add(struct flushq *fq, struct conn *c);
+int flushq_pending(struct flushq *fq);
+void flushq_drain(struct flushq *fq, void (*flush)(struct conn *c));
+void bring_init(int slots);
+
+#endif
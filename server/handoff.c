@@ -0,0 +1,431 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "serv.h"
+#include "conn.h"
+#include "log.h"
+#include "registry.h"
+#include "lockstat.h"
+#include "handoff.h"
+
+#define HO_FD_MAX 64            //한 번에 넘기는 리슨 소켓 / 깨울 리액터 최대 수
+
+//제어 소켓 메시지 종류
+#define HO_LISTEN 1             //리슨 소켓 목록 (새 프로세스가 1바이트로 응답해야 진행)
+#define HO_CONN 2               //연결 1개
+#define HO_END 3                //다 보냄
+
+struct ho_hello {
+        uint8_t type;
+        uint8_t version;
+        uint16_t n;
+};
+
+//같은 호스트의 같은 구조 바이너리끼리만 주고받으므로 구조체 그대로 (HO_VERSION으로 확인)
+struct ho_conn {
+        uint8_t type;
+        struct sockaddr_in peer;
+        struct player player;
+        uint32_t rx_len;        //아직 프레임이 덜 된 수신 데이터
+        char rx[];
+};
+
+volatile int handoff_phase = HO_NONE;
+
+//이 프로세스의 리슨 소켓과 단계가 바뀌면 깨울 eventfd
+static int listeners[HO_FD_MAX], n_listener;
+static int wakes[HO_FD_MAX], n_wake;
+
+//기존 프로세스에게서 넘겨받은 것
+static int inherited[HO_FD_MAX], n_inherited, inherit_pos;
+static struct conn **adopted;
+static int n_adopted, adopt_pos;
+
+//후임 프로세스와의 연결, 리액터들이 같이 보내므로 succ_lock
+static int succ = -1;
+static pthread_mutex_t succ_lock = PTHREAD_MUTEX_INITIALIZER;
+static long moved;
+
+//pthread_cond_wait가 안에서 풀었다 잡으므로 LOCK으로 재지 않음
+static pthread_mutex_t done_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t done_cond = PTHREAD_COND_INITIALIZER;
+static int n_done;
+
+static void *handoff_loop(void *arg);
+
+//이 설정으로 열게 될 리슨 소켓 수 (open_listener 호출 수와 같아야 함)
+static int want_listeners(void) {
+        int n = 1;
+
+        if(conf.mode == MODE_REUSEPORT || (conf.mode == MODE_URING && conf.n_reactor > 1)) {
+                n = conf.n_reactor;
+        }
+        return conf.unix_path != NULL ? n + 1 : n;
+}
+
+static int ctl_addr(char *path, struct sockaddr_un *addr) {
+        if(strlen(path) >= sizeof(addr->sun_path)) {
+                errno = ENAMETOOLONG;
+                return -1;
+        }
+        memset(addr, 0, sizeof(*addr));
+        addr->sun_family = AF_UNIX;
+        strcpy(addr->sun_path, path);
+        return 0;
+}
+
+//buf와 함께 fd n개를 SCM_RIGHTS로 보냄
+static int send_fds(int sock, void *buf, size_t len, int *fds, int n) {
+        char ctl[CMSG_SPACE(sizeof(int) * HO_FD_MAX)];
+        struct msghdr mh;
+        struct iovec iov;
+        struct cmsghdr *cm;
+
+        memset(&mh, 0, sizeof(mh));
+        iov.iov_base = buf;
+        iov.iov_len = len;
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        if(n > 0) {
+                memset(ctl, 0, sizeof(ctl));
+                mh.msg_control = ctl;
+                mh.msg_controllen = CMSG_SPACE(sizeof(int) * n);
+                cm = CMSG_FIRSTHDR(&mh);
+                cm->cmsg_level = SOL_SOCKET;
+                cm->cmsg_type = SCM_RIGHTS;
+                cm->cmsg_len = CMSG_LEN(sizeof(int) * n);
+                memcpy(CMSG_DATA(cm), fds, sizeof(int) * n);
+        }
+        return sendmsg(sock, &mh, MSG_NOSIGNAL) == (ssize_t)len ? 0 : -1;
+}
+
+//메시지 1개와 같이 온 fd를 받음, max개를 넘는 fd는 닫음
+static ssize_t recv_fds(int sock, void *buf, size_t len, int *fds, int *n, int max) {
+        char ctl[CMSG_SPACE(sizeof(int) * HO_FD_MAX)];
+        struct msghdr mh;
+        struct iovec iov;
+        struct cmsghdr *cm;
+        ssize_t ret;
+        int i, cnt, fd;
+
+        memset(&mh, 0, sizeof(mh));
+        iov.iov_base = buf;
+        iov.iov_len = len;
+        mh.msg_iov = &iov;
+        mh.msg_iovlen = 1;
+        mh.msg_control = ctl;
+        mh.msg_controllen = sizeof(ctl);
+        *n = 0;
+        ret = recvmsg(sock, &mh, MSG_CMSG_CLOEXEC);
+        if(ret <= 0) {
+                return ret;
+        }
+        for(cm = CMSG_FIRSTHDR(&mh) ; cm != NULL ; cm = CMSG_NXTHDR(&mh, cm)) {
+                if(cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) {
+                        continue;
+                }
+                cnt = (cm->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                for(i = 0 ; i < cnt ; i++) {
+                        memcpy(&fd, CMSG_DATA(cm) + i * sizeof(int), sizeof(int));
+                        if(*n < max) {
+                                fds[(*n)++] = fd;
+                        } else {
+                                close(fd);
+                        }
+                }
+        }
+        return ret;
+}
+
+//기존 프로세스가 있으면 리슨 소켓과 연결을 넘겨받음
+//기존 프로세스가 없으면 0, 넘겨받았으면 리슨 소켓 수, 실패하면 -1
+int handoff_recv(char *path) {
+        struct sockaddr_un addr;
+        struct ho_hello hello;
+        struct ho_conn *rec;
+        struct conn *c, **tmp;
+        ssize_t len;
+        int sock, fd, n, i;
+        char ok = 1;
+
+        if(ctl_addr(path, &addr) == -1) {
+                return -1;
+        }
+        sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        if(sock == -1) {
+                return -1;
+        }
+        if(connect(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1) {
+                //아무도 듣고 있지 않으면 처음 시작
+                close(sock);
+                return 0;
+        }
+
+        len = recv_fds(sock, &hello, sizeof(hello), inherited, &n_inherited, HO_FD_MAX);
+        if(len == sizeof(hello) && hello.type == HO_LISTEN && n_inherited != want_listeners()) {
+                fprintf(stderr, "hot restart : previous process has %d listener(s), this one needs %d (use the same -m and -t)\n",
+                        n_inherited, want_listeners());
+                len = 0;
+        }
+        if(len != sizeof(hello) || hello.type != HO_LISTEN || hello.version != HO_VERSION) {
+                //응답 없이 끊으면 기존 프로세스는 넘기기를 취소하고 계속 동작
+                for(i = 0 ; i < n_inherited ; i++) {
+                        close(inherited[i]);
+                }
+                n_inherited = 0;
+                close(sock);
+                errno = EPROTO;
+                return -1;
+        }
+        if(write(sock, &ok, 1) != 1) {
+                close(sock);
+                return -1;
+        }
+
+        rec = malloc(sizeof(*rec) + HO_RX_MAX);
+        if(rec == NULL) {
+                error_handling("malloc() error");
+        }
+        while(1) {
+                len = recv_fds(sock, rec, sizeof(*rec) + HO_RX_MAX, &fd, &n, 1);
+                if(len <= 0 || rec->type == HO_END) {
+                        break;
+                }
+                if(rec->type != HO_CONN || n != 1 || len < (ssize_t)sizeof(*rec) || len != (ssize_t)(sizeof(*rec) + rec->rx_len)) {
+                        if(n == 1) {
+                                close(fd);
+                        }
+                        continue;
+                }
+                c = conn_new(fd, NULL, &rec->peer);
+                if(c == NULL) {
+                        close(fd);
+                        continue;
+                }
+                c->player = rec->player;
+                //이름 테이블은 프로세스마다 따로 있으므로 새 ID로 다시 등록
+                if(c->player.login && name_claim(c->player.name, c->id) == -1) {
+                        c->player.login = 0;
+                }
+                if(rec->rx_len > 0 && frame_ring_write(&c->rx, rec->rx, rec->rx_len) == -1) {
+                        conn_close(c);
+                        continue;
+                }
+                tmp = realloc(adopted, sizeof(struct conn *) * (n_adopted + 1));
+                if(tmp == NULL) {
+                        conn_close(c);
+                        continue;
+                }
+                adopted = tmp;
+                adopted[n_adopted++] = c;
+        }
+        free(rec);
+        close(sock);
+
+        LOG(LOG_INFO, EV_HANDOFF, 0, n_inherited, n_adopted);
+        return n_inherited;
+}
+
+//넘겨받은 연결을 하나씩 꺼냄 (리액터가 자기 것으로 등록)
+struct conn *handoff_take(void) {
+        if(adopt_pos == n_adopted) {
+                return NULL;
+        }
+        return adopted[adopt_pos++];
+}
+
+//넘겨받은 리슨 소켓이 남아 있으면 하나 꺼냄, 없으면 -1
+int handoff_listener(void) {
+        if(inherit_pos == n_inherited) {
+                return -1;
+        }
+        return inherited[inherit_pos++];
+}
+
+//다음 프로세스에 넘길 리슨 소켓 등록
+void handoff_keep(int fd) {
+        if(n_listener < HO_FD_MAX) {
+                listeners[n_listener++] = fd;
+        }
+}
+
+//단계가 바뀌면 깨울 리액터의 eventfd 등록
+void handoff_add_wake(int efd) {
+        if(n_wake < HO_FD_MAX) {
+                wakes[n_wake++] = efd;
+        }
+}
+
+//리액터 준비가 끝난 뒤 호출, 다음 프로세스를 기다리는 제어 소켓을 염
+void handoff_serve(void) {
+        struct sockaddr_un addr;
+        pthread_t t_id;
+        int sock;
+
+        if(conf.restart_path == NULL) {
+                return;
+        }
+        free(adopted);
+        adopted = NULL;
+        n_adopted = adopt_pos = 0;
+
+        if(conf.n_reactor > HO_FD_MAX) {
+                fprintf(stderr, "hot restart : more than %d reactors, disabled\n", HO_FD_MAX);
+                return;
+        }
+        if(ctl_addr(conf.restart_path, &addr) == -1) {
+                fprintf(stderr, "hot restart : bad path %s\n", conf.restart_path);
+                return;
+        }
+        sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+        //이전 프로세스의 소켓 파일이 남아 있으면 지우고 다시 만듦
+        unlink(conf.restart_path);
+        if(sock == -1 || bind(sock, (struct sockaddr*)&addr, sizeof(addr)) == -1 || listen(sock, 1) == -1) {
+                fprintf(stderr, "hot restart : cannot listen on %s (%s)\n", conf.restart_path, strerror(errno));
+                if(sock != -1) {
+                        close(sock);
+                }
+                return;
+        }
+        pthread_create(&t_id, NULL, handoff_loop, (void *)(intptr_t)sock);
+        pthread_detach(t_id);
+}
+
+//단계를 바꾸고 모든 리액터가 처리할 때까지 대기
+static void set_phase(int phase) {
+        uint64_t one = 1;
+        int i;
+
+        pthread_mutex_lock(&done_lock);
+        n_done = 0;
+        __atomic_store_n(&handoff_phase, phase, __ATOMIC_RELEASE);
+        pthread_mutex_unlock(&done_lock);
+
+        for(i = 0 ; i < n_wake ; i++) {
+                write(wakes[i], &one, sizeof(one));
+        }
+
+        pthread_mutex_lock(&done_lock);
+        while(n_done < n_wake) {
+                pthread_cond_wait(&done_cond, &done_lock);
+        }
+        pthread_mutex_unlock(&done_lock);
+}
+
+//리액터가 현재 단계를 처리했음
+void handoff_done(void) {
+        pthread_mutex_lock(&done_lock);
+        n_done++;
+        pthread_cond_signal(&done_cond);
+        pthread_mutex_unlock(&done_lock);
+}
+
+//송신 큐를 비울 때까지 최대 HO_FLUSH_MS 동안 기다림
+static int flush_wait(struct conn *c) {
+        struct pollfd pfd;
+        long until = now_ms() + HO_FLUSH_MS, left;
+        int ret;
+
+        while((ret = conn_flush(c)) == 1) {
+                left = until - now_ms();
+                pfd.fd = c->fd;
+                pfd.events = POLLOUT;
+                if(left <= 0 || poll(&pfd, 1, left) <= 0) {
+                        return -1;
+                }
+        }
+        return ret;
+}
+
+//연결 1개를 후임 프로세스로 넘김 (소유 리액터에서 호출), 넘겼으면 0
+//넘긴 뒤 호출한 쪽에서 이벤트 등록을 풀고 conn_close (소켓은 후임 프로세스의 fd로 유지됨)
+int handoff_conn(struct conn *c) {
+        struct ho_conn *rec;
+        unsigned used = c->rx.tail - c->rx.head;
+        int ret;
+
+        //공유 메모리 연결은 링을 넘길 수 없으므로 끊길 때까지 이 프로세스가 처리
+        if(succ == -1 || c->closed || c->kill || c->shm != NULL || used > HO_RX_MAX) {
+                return -1;
+        }
+        //이미 큐에 들어간 메시지는 여기서 다 보내야 순서가 유지됨
+        if(flush_wait(c) == -1) {
+                return -1;
+        }
+        rec = malloc(sizeof(*rec) + used);
+        if(rec == NULL) {
+                return -1;
+        }
+        memset(rec, 0, sizeof(*rec));
+        rec->type = HO_CONN;
+        rec->peer = c->peer;
+        rec->player = c->player;
+        rec->rx_len = used;
+        //수신 링의 남은 데이터는 항상 연속 (이중 매핑이거나 앞으로 당겨둠)
+        memcpy(rec->rx, c->rx.buf + c->rx.head % c->rx.cap, used);
+
+        LOCK(&succ_lock);
+        ret = send_fds(succ, rec, sizeof(*rec) + used, &c->fd, 1);
+        UNLOCK(&succ_lock);
+        free(rec);
+        if(ret == 0) {
+                __atomic_add_fetch(&moved, 1, __ATOMIC_RELAXED);
+        }
+        return ret;
+}
+
+//후임 프로세스를 기다렸다가 넘기고, 남은 연결이 모두 끝나면 종료
+static void *handoff_loop(void *arg) {
+        struct timespec ts = { 0, 100 * 1000000L };
+        struct ho_hello hello;
+        int ctl = (int)(intptr_t)arg;
+        char ok;
+
+        //후임이 리슨 소켓을 받았다고 응답해야 진행, 도중에 끊기면 다음 접속을 기다림
+        while(1) {
+                succ = accept(ctl, NULL, NULL);
+                if(succ == -1) {
+                        nanosleep(&ts, NULL);
+                        continue;
+                }
+                hello.type = HO_LISTEN;
+                hello.version = HO_VERSION;
+                hello.n = n_listener;
+                if(send_fds(succ, &hello, sizeof(hello), listeners, n_listener) == 0 && read(succ, &ok, 1) == 1) {
+                        break;
+                }
+                close(succ);
+                succ = -1;
+        }
+        //제어 소켓 경로는 후임이 다시 만듦
+        close(ctl);
+
+        set_phase(HO_STOP);
+        set_phase(HO_MOVE);
+
+        hello.type = HO_END;
+        LOCK(&succ_lock);
+        send_fds(succ, &hello, sizeof(hello), NULL, 0);
+        close(succ);
+        succ = -1;
+        UNLOCK(&succ_lock);
+        LOG(LOG_INFO, EV_HANDOFF, 1, n_listener, moved);
+
+        //넘기지 못한 연결 (io_uring, 스레드 모드 등)은 끝날 때까지 계속 처리
+        while(conn_count() > 0) {
+                nanosleep(&ts, NULL);
+        }
+        LOG(LOG_INFO, EV_HANDOFF, 2, 0, 0);
+        //로그 스레드가 마지막 레코드를 쓸 시간
+        ts.tv_nsec = LOG_FLUSH_MS * 2 * 1000000L;
+        nanosleep(&ts, NULL);
+        exit(0);
+}
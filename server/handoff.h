@@ -0,0 +1,29 @@
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+//핫 리스타트 : 새 프로세스가 제어 소켓(UNIX, SOCK_SEQPACKET)으로 접속하면
+//기존 프로세스가 리슨 소켓과 연결을 SCM_RIGHTS로 넘기고 남은 연결이 끝나면 종료
+
+#define HO_VERSION 2            //레코드 구조가 바뀌면 올림
+#define HO_RX_MAX 65536         //넘겨줄 수 있는 수신 링 잔여 데이터 (넘으면 기존 프로세스가 계속 처리)
+#define HO_FLUSH_MS 1000        //넘기기 전에 송신 큐를 비우며 기다리는 최대 시간
+
+//기존 프로세스의 단계 (리액터가 handoff_phase가 바뀐 걸 보고 처리한 뒤 handoff_done 호출)
+#define HO_NONE 0
+#define HO_STOP 1               //accept 중단, 리슨 소켓 닫기
+#define HO_MOVE 2               //자기 연결을 handoff_conn으로 넘기기
+
+struct conn;
+
+int handoff_recv(char *path);
+struct conn *handoff_take(void);
+int handoff_listener(void);
+void handoff_keep(int fd);
+void handoff_add_wake(int efd);
+void handoff_serve(void);
+int handoff_conn(struct conn *c);
+void handoff_done(void);
+
+extern volatile int handoff_phase;
+
+#endif
@@ -0,0 +1,32 @@
+#!/bin/sh
+# 기본 모드와 저지연 모드(-L)의 중계 지연 비교
+# 대결 1개(2명)가 interval_us마다 메시지를 주고받는 상황에서 p50/p99를 출력
+#
+# 사용법 : ./lat_bench.sh [epoll|uring|thread] [msgs] [interval_us] [busy_poll_us]
+# serv, bench와 같은 디렉터리에서 실행
+
+MODE=${1:-epoll}
+MSGS=${2:-5000}
+INTERVAL=${3:-200}
+BUSY_POLL=${4:-50}
+PORT=9190
+
+# run <이름> [serv 옵션...]
+run() {
+        name=$1
+        shift
+        ./serv -m "$MODE" -t 1 "$@" $PORT > /dev/null 2>&1 &
+        pid=$!
+        sleep 0.3
+        printf "%-10s" "$name"
+        ./bench 127.0.0.1 $PORT 2 1 "$MSGS" "$INTERVAL" | grep latency
+        kill $pid
+        wait $pid 2> /dev/null
+        # io_uring은 리슨 소켓이 조금 늦게 풀림
+        sleep 1
+}
+
+echo "mode $MODE, $MSGS msgs every $INTERVAL us"
+run default
+run nodelay -L nodelay,$BUSY_POLL
+run spin -L spin,$BUSY_POLL
@@ -0,0 +1,160 @@
+#ifdef LOCK_STAT
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "lockstat.h"
+
+//이 스레드가 잡고 있는 측정 대상 (보유 시간 계산용)
+struct held {
+        pthread_mutex_t *m;
+        struct lock_site *s;
+        uint64_t since;
+};
+
+static __thread struct held held[LS_DEPTH];
+static __thread int n_held;
+static struct lock_site *sites;         //등록된 위치 목록 (앞에만 추가)
+
+static uint64_t ls_now(void);
+static int bucket(uint64_t ns);
+static void record(long *hist, unsigned long *sum, unsigned long *max, uint64_t ns);
+static unsigned long pct(long *hist, long total, int p);
+static int cmp_wait(const void *a, const void *b);
+
+static uint64_t ls_now(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static int bucket(uint64_t ns) {
+        int i = ns == 0 ? 0 : 63 - __builtin_clzll(ns);
+
+        return i < LS_BUCKETS ? i : LS_BUCKETS - 1;
+}
+
+//여러 스레드가 같은 위치에 쓰므로 전부 atomic
+static void record(long *hist, unsigned long *sum, unsigned long *max, uint64_t ns) {
+        unsigned long old = __atomic_load_n(max, __ATOMIC_RELAXED);
+
+        __atomic_add_fetch(&hist[bucket(ns)], 1, __ATOMIC_RELAXED);
+        __atomic_add_fetch(sum, ns, __ATOMIC_RELAXED);
+        while(ns > old && !__atomic_compare_exchange_n(max, &old, ns, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        }
+}
+
+//먼저 trylock으로 잡아 보고, 실패했을 때만 기다린 시간을 잼
+void lock_enter(struct lock_site *s, pthread_mutex_t *m) {
+        uint64_t t0, t1;
+        int expect = 0;
+
+        if(!__atomic_load_n(&s->registered, __ATOMIC_ACQUIRE)
+                && __atomic_compare_exchange_n(&s->registered, &expect, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                s->next = __atomic_load_n(&sites, __ATOMIC_RELAXED);
+                while(!__atomic_compare_exchange_n(&sites, &s->next, s, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+                }
+        }
+
+        if(pthread_mutex_trylock(m) == 0) {
+                t1 = ls_now();
+                __atomic_add_fetch(&s->wait_hist[0], 1, __ATOMIC_RELAXED);
+        } else {
+                t0 = ls_now();
+                pthread_mutex_lock(m);
+                t1 = ls_now();
+                __atomic_add_fetch(&s->contended, 1, __ATOMIC_RELAXED);
+                record(s->wait_hist, &s->wait_ns, &s->wait_max, t1 - t0);
+        }
+        __atomic_add_fetch(&s->acquired, 1, __ATOMIC_RELAXED);
+
+        if(n_held < LS_DEPTH) {
+                held[n_held].m = m;
+                held[n_held].s = s;
+                held[n_held].since = t1;
+        }
+        n_held++;
+}
+
+//잡은 순서와 다르게 풀 수 있으므로 위에서부터 찾음
+void lock_leave(pthread_mutex_t *m) {
+        uint64_t now = ls_now();
+        int i;
+
+        for(i = (n_held < LS_DEPTH ? n_held : LS_DEPTH) - 1 ; i >= 0 && held[i].m != m ; i--) {
+        }
+        if(i >= 0) {
+                record(held[i].s->hold_hist, &held[i].s->hold_ns, &held[i].s->hold_max, now - held[i].since);
+                for( ; i + 1 < n_held && i + 1 < LS_DEPTH ; i++) {
+                        held[i] = held[i + 1];
+                }
+        }
+        if(n_held > 0) {
+                n_held--;
+        }
+        pthread_mutex_unlock(m);
+}
+
+//히스토그램에서 p% 지점 칸의 위쪽 경계 (ns), 0번 칸(경합 없음)이면 0
+static unsigned long pct(long *hist, long total, int p) {
+        long sum = 0, want = (total * p + 99) / 100;
+        int i;
+
+        if(total == 0) {
+                return 0;
+        }
+        for(i = 0 ; i < LS_BUCKETS - 1 ; i++) {
+                sum += __atomic_load_n(&hist[i], __ATOMIC_RELAXED);
+                if(sum >= want) {
+                        break;
+                }
+        }
+        return i == 0 ? 0 : 2UL << i;
+}
+
+//기다린 시간 합이 큰 순서
+static int cmp_wait(const void *a, const void *b) {
+        unsigned long x = (*(struct lock_site **)a)->wait_ns, y = (*(struct lock_site **)b)->wait_ns;
+
+        return x < y ? 1 : x > y ? -1 : 0;
+}
+
+void lock_dump(void) {
+        struct lock_site *s, **tab;
+        long acq;
+        int n = 0, i;
+
+        for(s = __atomic_load_n(&sites, __ATOMIC_ACQUIRE) ; s != NULL ; s = s->next) {
+                n++;
+        }
+        tab = malloc(sizeof(*tab) * (n > 0 ? n : 1));
+        if(tab == NULL) {
+                return;
+        }
+        for(i = 0, s = __atomic_load_n(&sites, __ATOMIC_ACQUIRE) ; s != NULL && i < n ; s = s->next) {
+                tab[i++] = s;
+        }
+        qsort(tab, n, sizeof(*tab), cmp_wait);
+
+        fprintf(stderr, "locks : %d site(s), times in ns (p50/p99 are histogram bucket bounds)\n", n);
+        fprintf(stderr, "  %10s %10s %12s %26s %26s  %s\n", "acquired", "contended", "wait total",
+                "wait p50/p99/max", "hold avg/p99/max", "site");
+        for(i = 0 ; i < n ; i++) {
+                s = tab[i];
+                acq = __atomic_load_n(&s->acquired, __ATOMIC_RELAXED);
+                fprintf(stderr, "  %10ld %10ld %12lu %8lu/%8lu/%8lu %8lu/%8lu/%8lu  %s %s:%d\n",
+                        acq, __atomic_load_n(&s->contended, __ATOMIC_RELAXED),
+                        __atomic_load_n(&s->wait_ns, __ATOMIC_RELAXED),
+                        pct(s->wait_hist, acq, 50), pct(s->wait_hist, acq, 99),
+                        __atomic_load_n(&s->wait_max, __ATOMIC_RELAXED),
+                        acq > 0 ? __atomic_load_n(&s->hold_ns, __ATOMIC_RELAXED) / acq : 0,
+                        pct(s->hold_hist, acq, 99),
+                        __atomic_load_n(&s->hold_max, __ATOMIC_RELAXED),
+                        s->name, s->file, s->line);
+        }
+        free(tab);
+}
+
+#endif
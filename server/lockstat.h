@@ -0,0 +1,47 @@
+#ifndef LOCKSTAT_H
+#define LOCKSTAT_H
+
+#include <pthread.h>
+
+//뮤텍스 경합 측정 : -DLOCK_STAT으로 빌드하면 LOCK/UNLOCK 위치마다 횟수와 대기/보유 시간을 모음
+//끄면 pthread_mutex_lock/unlock 그대로라서 비용 없음, 결과는 SIGUSR1 덤프에 같이 출력
+
+#ifdef LOCK_STAT
+
+#define LS_BUCKETS 32           //시간 히스토그램 칸 수, i번 칸 = [2^i, 2^(i+1)) ns
+#define LS_DEPTH 8              //스레드 하나가 동시에 잡고 있을 수 있는 측정 대상 수
+
+//LOCK을 부른 위치 하나 (정적 변수로 만들어 처음 잡을 때 목록에 등록)
+struct lock_site {
+        const char *name;       //LOCK에 넘긴 식 그대로
+        const char *file;
+        int line;
+        int registered;
+        long acquired;
+        long contended;         //trylock이 실패해서 기다린 횟수
+        unsigned long wait_ns, hold_ns;
+        unsigned long wait_max, hold_max;
+        long wait_hist[LS_BUCKETS];
+        long hold_hist[LS_BUCKETS];
+        struct lock_site *next;
+};
+
+#define LOCK(m) do { \
+                static struct lock_site ls_site_ = { #m, __FILE__, __LINE__ }; \
+                lock_enter(&ls_site_, (m)); \
+        } while(0)
+#define UNLOCK(m) lock_leave(m)
+
+void lock_enter(struct lock_site *s, pthread_mutex_t *m);
+void lock_leave(pthread_mutex_t *m);
+void lock_dump(void);
+
+#else
+
+#define LOCK(m) pthread_mutex_lock(m)
+#define UNLOCK(m) pthread_mutex_unlock(m)
+#define lock_dump() do { } while(0)
+
+#endif
+
+#endif
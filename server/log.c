@@ -0,0 +1,240 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <pthread.h>
+#include <arpa/inet.h>
+#include "serv.h"
+#include "log.h"
+#include "lockstat.h"
+
+//스레드별 단일 생산자/단일 소비자 링
+//생산자는 tail만, 로그 스레드는 head만 씀
+struct log_ring {
+        struct log_rec rec[LOG_RING];
+        unsigned head __attribute__((aligned(64)));
+        unsigned tail __attribute__((aligned(64)));
+        unsigned sample_cnt;
+        long dropped;           //링이 가득 차서 버린 레코드 (생산자만 증가)
+        long dropped_seen;      //로그 스레드가 이미 보고한 값
+        int dead;               //스레드가 끝남, 다 비우면 로그 스레드가 해제
+        struct log_ring *next;
+};
+
+int log_level = LOG_INFO;
+static int log_sample = 1;
+static FILE *log_fp;
+
+static struct log_ring *rings = NULL;
+static pthread_mutex_t rings_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t ring_key;
+static __thread struct log_ring *my_ring;
+
+static char *level_names[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+static char *mode_names[] = { "thread", "epoll", "reuseport", "io_uring" };
+
+static void *log_loop(void *arg);
+
+static void ring_release(void *arg) {
+        struct log_ring *r = (struct log_ring *)arg;
+
+        __atomic_store_n(&r->dead, 1, __ATOMIC_RELEASE);
+}
+
+static struct log_ring *ring_get(void) {
+        struct log_ring *r = my_ring;
+
+        if(r != NULL) {
+                return r;
+        }
+        r = calloc(1, sizeof(*r));
+        if(r == NULL) {
+                return NULL;
+        }
+        pthread_setspecific(ring_key, r);
+        LOCK(&rings_lock);
+        r->next = rings;
+        rings = r;
+        UNLOCK(&rings_lock);
+        my_ring = r;
+        return r;
+}
+
+//path가 "-"면 표준 출력
+int log_init(char *path, int level, int sample) {
+        pthread_t t_id;
+
+        log_fp = strcmp(path, "-") ? fopen(path, "a") : stdout;
+        if(log_fp == NULL) {
+                return -1;
+        }
+        log_level = level;
+        log_sample = sample > 0 ? sample : 1;
+        pthread_key_create(&ring_key, ring_release);
+        if(pthread_create(&t_id, NULL, log_loop, NULL) != 0) {
+                return -1;
+        }
+        pthread_detach(t_id);
+        return 0;
+}
+
+//레코드 하나를 자기 링에 씀, 가득 차면 버리고 개수만 셈
+void log_write(int level, int event, uint32_t a, uint64_t b, uint64_t c) {
+        struct log_ring *r = ring_get();
+        struct log_rec *rec;
+        struct timespec ts;
+        unsigned tail;
+
+        if(r == NULL) {
+                return;
+        }
+        //메시지 중계(RELAY, DIRECT) 이벤트는 sample개 중 1개만 기록
+        if((event == EV_RELAY || event == EV_DIRECT) && log_sample > 1 && r->sample_cnt++ % log_sample != 0) {
+                return;
+        }
+        tail = r->tail;
+        if(tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) >= LOG_RING) {
+                __atomic_store_n(&r->dropped, r->dropped + 1, __ATOMIC_RELAXED);
+                return;
+        }
+        clock_gettime(CLOCK_REALTIME_COARSE, &ts);
+        rec = &r->rec[tail & (LOG_RING - 1)];
+        rec->ts = ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+        rec->event = event;
+        rec->level = level;
+        rec->a = a;
+        rec->b = b;
+        rec->c = c;
+        __atomic_store_n(&r->tail, tail + 1, __ATOMIC_RELEASE);
+}
+
+int log_parse_level(char *name) {
+        int i;
+
+        for(i = LOG_DEBUG ; i <= LOG_ERROR ; i++) {
+                if(!strcasecmp(name, level_names[i])) {
+                        return i;
+                }
+        }
+        return -1;
+}
+
+static void format_rec(struct log_rec *rec) {
+        struct in_addr addr;
+        struct tm tm;
+        time_t sec = rec->ts / 1000000000ULL;
+        char when[32];
+
+        localtime_r(&sec, &tm);
+        strftime(when, sizeof(when), "%H:%M:%S", &tm);
+        fprintf(log_fp, "%s.%03d %-5s ", when, (int)(rec->ts / 1000000 % 1000), level_names[rec->level & 3]);
+
+        switch(rec->event) {
+        case EV_START:
+                if(rec->a == MODE_THREAD) {
+                        fprintf(log_fp, "%s mode\n", mode_names[rec->a & 3]);
+                } else {
+                        fprintf(log_fp, "%s mode : %lu reactor(s)\n", mode_names[rec->a & 3], (unsigned long)rec->b);
+                }
+                break;
+        case EV_CONNECT:
+                addr.s_addr = (uint32_t)rec->b;
+                //UNIX 소켓 연결은 주소가 0
+                fprintf(log_fp, "#%08x connected from %s (reactor %lu)\n", rec->a,
+                        rec->b ? inet_ntoa(addr) : "local (unix)", (unsigned long)rec->c);
+                break;
+        case EV_CLOSE:
+                fprintf(log_fp, "#%08x closed : in %lu, out %lu\n", rec->a, (unsigned long)rec->b, (unsigned long)rec->c);
+                break;
+        case EV_RELAY:
+                fprintf(log_fp, "#%08x relay type %lu, %lu bytes\n", rec->a, (unsigned long)rec->b, (unsigned long)rec->c);
+                break;
+        case EV_BADFRAME:
+                fprintf(log_fp, "#%08x bad frame, closing\n", rec->a);
+                break;
+        case EV_KICK:
+                fprintf(log_fp, "#%08x %s, closing\n", rec->a, rec->b ? "kicked by admin" : "send queue over limit");
+                break;
+        case EV_TIMEOUT:
+                fprintf(log_fp, "#%08x %s, idle %lu ms, closing\n", rec->a,
+                        rec->c ? "send stalled" : "no heartbeat", (unsigned long)rec->b);
+                break;
+        case EV_LIMIT:
+                fprintf(log_fp, "#%08x over rate limit (type %lu), %s\n", rec->a, (unsigned long)rec->b,
+                        rec->c ? "closing" : "dropped");
+                break;
+        case EV_BUSY:
+                addr.s_addr = rec->a;
+                fprintf(log_fp, "busy : rejected %s (%s), retry in %lu ms\n", inet_ntoa(addr),
+                        rec->b == 0 ? "max connections" : "accept rate", (unsigned long)rec->c);
+                break;
+        case EV_LOGIN:
+                fprintf(log_fp, "#%08x login %s (%lu names)\n", rec->a, rec->b ? "ok" : "refused, name in use",
+                        (unsigned long)rec->c);
+                break;
+        case EV_DIRECT:
+                fprintf(log_fp, "#%08x direct type %lu to %lu client(s)\n", rec->a, (unsigned long)rec->b,
+                        (unsigned long)rec->c);
+                break;
+        case EV_HANDOFF:
+                if(rec->a == 2) {
+                        fprintf(log_fp, "hot restart : all connections drained, exiting\n");
+                } else {
+                        fprintf(log_fp, "hot restart : %s %lu listener(s), %lu connection(s)\n",
+                                rec->a ? "handed off" : "took over", (unsigned long)rec->b, (unsigned long)rec->c);
+                }
+                break;
+        default:
+                fprintf(log_fp, "event %d : %u %lu %lu\n", rec->event, rec->a, (unsigned long)rec->b, (unsigned long)rec->c);
+        }
+}
+
+//링 하나를 비움, 스레드가 끝났고 다 비웠으면 1
+static int drain_ring(struct log_ring *r) {
+        unsigned head = r->head, tail;
+        int dead = __atomic_load_n(&r->dead, __ATOMIC_ACQUIRE);
+        long dropped;
+
+        tail = __atomic_load_n(&r->tail, __ATOMIC_ACQUIRE);
+        for( ; head != tail ; head++) {
+                format_rec(&r->rec[head & (LOG_RING - 1)]);
+        }
+        __atomic_store_n(&r->head, head, __ATOMIC_RELEASE);
+
+        dropped = __atomic_load_n(&r->dropped, __ATOMIC_RELAXED);
+        if(dropped != r->dropped_seen) {
+                fprintf(log_fp, "log : %ld record(s) dropped\n", dropped - r->dropped_seen);
+                r->dropped_seen = dropped;
+        }
+        return dead;
+}
+
+//LOG_FLUSH_MS마다 모든 링을 비우고 파일에 flush
+static void *log_loop(void *arg) {
+        struct timespec ts = { 0, LOG_FLUSH_MS * 1000000L };
+        struct log_ring *r, *next, **prev;
+
+        while(1) {
+                nanosleep(&ts, NULL);
+
+                LOCK(&rings_lock);
+                r = rings;
+                UNLOCK(&rings_lock);
+                //새 링은 항상 앞에 붙으므로 가져온 r부터 뒤쪽은 로그 스레드만 바꿈
+                while(r != NULL) {
+                        next = r->next;
+                        if(drain_ring(r)) {
+                                //끝난 스레드의 링 정리, 앞쪽 연결은 생산자가 바꿀 수 있으므로 lock
+                                LOCK(&rings_lock);
+                                for(prev = &rings ; *prev != r ; prev = &(*prev)->next);
+                                *prev = next;
+                                UNLOCK(&rings_lock);
+                                free(r);
+                        }
+                        r = next;
+                }
+                fflush(log_fp);
+        }
+        return NULL;
+}
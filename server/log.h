@@ -0,0 +1,54 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+
+//비동기 로그
+//각 스레드는 자기 링에 고정 크기 레코드만 쓰고, 로그 스레드가 모아서 문자열로 바꿔 파일에 씀
+
+#define LOG_RING 4096           //스레드별 링 크기 (레코드 수, 2의 거듭제곱)
+#define LOG_FLUSH_MS 50         //로그 스레드가 링을 확인하는 주기
+
+//로그 레벨
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_WARN 2
+#define LOG_ERROR 3
+
+//이벤트 (인자 의미는 log.c의 format_rec 참고)
+#define EV_START 0              //a = 모드, b = 리액터 수
+#define EV_CONNECT 1            //a = 연결 id, b = IP, c = 리액터
+#define EV_CLOSE 2              //a = 연결 id, b = 받은 메시지, c = 보낸 메시지
+#define EV_RELAY 3              //a = 연결 id, b = 프레임 타입, c = 길이 (샘플링 대상)
+#define EV_BADFRAME 4           //a = 연결 id
+#define EV_KICK 5               //a = 연결 id, b = 0 송신 큐 초과 / 1 관리 콘솔, 연결 종료
+#define EV_TIMEOUT 6            //a = 연결 id, b = 마지막 수신 후 ms, c = 송신이 막혔는지
+#define EV_HANDOFF 7            //a = 0 받음 / 1 넘김 / 2 종료, b = 리슨 소켓 수, c = 연결 수
+#define EV_LIMIT 8              //a = 연결 id, b = 프레임 타입, c = 연결을 끊었는지
+#define EV_BUSY 9               //a = IP, b = 이유 (proto.h BUSY_*), c = 재시도 ms
+#define EV_LOGIN 10             //a = 연결 id, b = 성공 여부, c = 등록된 이름 수
+#define EV_DIRECT 11            //a = 연결 id, b = 프레임 타입, c = 받은 연결 수
+
+struct log_rec {
+        uint64_t ts;            //CLOCK_REALTIME_COARSE, ns
+        uint16_t event;
+        uint8_t level;
+        uint8_t pad;
+        uint32_t a;
+        uint64_t b, c;
+};
+
+extern int log_level;
+
+//레벨이 낮으면 인자 계산도 하지 않음
+#define LOG(level, ev, a, b, c) do { \
+        if((level) >= __atomic_load_n(&log_level, __ATOMIC_RELAXED)) { \
+                log_write((level), (ev), (a), (b), (c)); \
+        } \
+} while(0)
+
+int log_init(char *path, int level, int sample);
+void log_write(int level, int event, uint32_t a, uint64_t b, uint64_t c);
+int log_parse_level(char *name);
+
+#endif
@@ -0,0 +1,315 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <time.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include "serv.h"
+#include "lockstat.h"
+#include "metrics.h"
+
+#define MF_MAX 32               //콜백 메트릭 최대 수
+#define MP_MAX 4                //스크레이프 전 콜백 최대 수
+#define REQ_MAX 2048
+#define ACCEPT_BACKOFF_MS 100   //accept가 fd 부족 등으로 실패하면 쉬는 시간
+
+//스레드 하나의 메트릭, 쓰는 건 그 스레드뿐이라서 원자적 RMW 없이 저장만 atomic
+//스레드가 끝나면 used를 내리고 다음 스레드가 누적값을 이어서 씀
+struct m_shard {
+        uint64_t cnt[M_COUNTERS];
+        uint64_t hist[M_HISTS][H_BUCKETS];
+        uint64_t hsum[M_HISTS];
+        int used;
+        struct m_shard *next;
+} __attribute__((aligned(64)));
+
+//읽을 때 계산하는 메트릭
+struct m_func {
+        char *name;
+        char *help;
+        int type;
+        long (*fn)(void);
+        long *p;
+};
+
+static char *cnt_names[M_COUNTERS][2] = {
+        { "serv_connections_accepted_total", "Connections accepted" },
+        { "serv_connections_closed_total", "Connections closed" },
+        { "serv_messages_received_total", "Frames received from clients" },
+        { "serv_received_bytes_total", "Bytes received from clients (frame headers included)" },
+        { "serv_messages_sent_total", "Frames written to clients, one per recipient" },
+        { "serv_sent_bytes_total", "Bytes written to clients" },
+        { "serv_messages_relayed_total", "Frames relayed (broadcast and direct)" },
+};
+
+static struct m_shard *shards;
+static pthread_mutex_t shard_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_key_t shard_key;
+static pthread_once_t shard_once = PTHREAD_ONCE_INIT;
+static __thread struct m_shard *my_shard;
+
+static struct m_func funcs[MF_MAX];
+static int n_func;
+static void (*preps[MP_MAX])(void);
+static int n_prep;
+static pthread_mutex_t scrape_lock = PTHREAD_MUTEX_INITIALIZER;   //HTTP와 관리 콘솔이 동시에 읽어도 prep 결과가 섞이지 않게
+static int m_sock = -1;
+
+static struct m_shard *shard_get(void);
+static void shard_release(void *arg);
+static void shard_key_init(void);
+static int h_index(uint64_t v);
+static void write_hist(FILE *fp, int h, char *name, char *help, double scale, int lo, int hi);
+static void *metrics_loop(void *arg);
+
+static void shard_release(void *arg) {
+        struct m_shard *s = (struct m_shard *)arg;
+
+        __atomic_store_n(&s->used, 0, __ATOMIC_RELEASE);
+}
+
+static void shard_key_init(void) {
+        pthread_key_create(&shard_key, shard_release);
+}
+
+//처음 쓰는 스레드는 놀고 있는 칸을 가져오거나 새로 만듦
+static struct m_shard *shard_get(void) {
+        struct m_shard *s = my_shard;
+        int expect;
+
+        if(s != NULL) {
+                return s;
+        }
+        pthread_once(&shard_once, shard_key_init);
+        LOCK(&shard_lock);
+        for(s = shards ; s != NULL ; s = s->next) {
+                expect = 0;
+                if(__atomic_compare_exchange_n(&s->used, &expect, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)) {
+                        break;
+                }
+        }
+        if(s == NULL && (s = calloc(1, sizeof(*s))) != NULL) {
+                s->used = 1;
+                s->next = shards;
+                __atomic_store_n(&shards, s, __ATOMIC_RELEASE);
+        }
+        UNLOCK(&shard_lock);
+        if(s != NULL) {
+                pthread_setspecific(shard_key, s);
+        }
+        my_shard = s;
+        return s;
+}
+
+void metric_add(int i, long n) {
+        struct m_shard *s = shard_get();
+
+        if(s != NULL) {
+                __atomic_store_n(&s->cnt[i], s->cnt[i] + n, __ATOMIC_RELAXED);
+        }
+}
+
+//v < H_SUB는 그대로, 그 위는 최상위 비트 구간 안에서 H_SUB칸으로 나눔
+static int h_index(uint64_t v) {
+        int e;
+
+        if(v < H_SUB) {
+                return v;
+        }
+        e = 63 - __builtin_clzll(v);
+        return (e - H_SUB_BITS + 1) * H_SUB + ((v >> (e - H_SUB_BITS)) & (H_SUB - 1));
+}
+
+void metric_hist(int h, uint64_t v) {
+        struct m_shard *s = shard_get();
+        int i = h_index(v);
+
+        if(s != NULL) {
+                __atomic_store_n(&s->hist[h][i], s->hist[h][i] + 1, __ATOMIC_RELAXED);
+                __atomic_store_n(&s->hsum[h], s->hsum[h] + v, __ATOMIC_RELAXED);
+        }
+}
+
+uint64_t metric_ns(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+//읽을 때 fn을 호출 (metrics_start 전에 등록)
+void metric_func(char *name, char *help, int type, long (*fn)(void)) {
+        if(n_func < MF_MAX) {
+                funcs[n_func].name = name;
+                funcs[n_func].help = help;
+                funcs[n_func].type = type;
+                funcs[n_func].fn = fn;
+                funcs[n_func].p = NULL;
+                n_func++;
+        }
+}
+
+//스크레이프마다 게이지 콜백보다 먼저 한 번 호출 (여러 게이지가 같은 연결 순회 결과를 나눠 쓸 때)
+void metric_prep(void (*fn)(void)) {
+        if(n_prep < MP_MAX) {
+                preps[n_prep++] = fn;
+        }
+}
+
+//읽을 때 *p를 그대로 (다른 모듈이 atomic으로 세는 값)
+void metric_long(char *name, char *help, int type, long *p) {
+        if(n_func < MF_MAX) {
+                funcs[n_func].name = name;
+                funcs[n_func].help = help;
+                funcs[n_func].type = type;
+                funcs[n_func].fn = NULL;
+                funcs[n_func].p = p;
+                n_func++;
+        }
+}
+
+//le 경계는 2^e와 1.5 * 2^e (e = lo..hi), 칸 경계와 맞으므로 누적값이 정확함
+//폭이 1인 칸(2 * H_SUB 미만)은 경계값까지 포함, 그 위는 경계값 바로 아래까지 (ns 단위에서는 차이 없음)
+static void write_hist(FILE *fp, int h, char *name, char *help, double scale, int lo, int hi) {
+        uint64_t cum[H_BUCKETS + 1], sum = 0, b;
+        struct m_shard *s;
+        int i, e, k;
+
+        memset(cum, 0, sizeof(cum));
+        for(s = __atomic_load_n(&shards, __ATOMIC_ACQUIRE) ; s != NULL ; s = s->next) {
+                for(i = 0 ; i < H_BUCKETS ; i++) {
+                        cum[i + 1] += __atomic_load_n(&s->hist[h][i], __ATOMIC_RELAXED);
+                }
+                sum += __atomic_load_n(&s->hsum[h], __ATOMIC_RELAXED);
+        }
+        //cum[i] = i번 칸보다 작은 값의 수
+        for(i = 1 ; i <= H_BUCKETS ; i++) {
+                cum[i] += cum[i - 1];
+        }
+
+        fprintf(fp, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+        for(e = lo ; e <= hi ; e++) {
+                for(k = 0 ; k < 2 ; k++) {
+                        b = k == 0 ? 1ULL << e : 3ULL << (e - 1);
+                        if(e == 0 && k == 1) {
+                                continue;
+                        }
+                        fprintf(fp, "%s_bucket{le=\"%g\"} %lu\n", name, b * scale, (unsigned long)cum[h_index(b) + (b < 2 * H_SUB)]);
+                }
+        }
+        fprintf(fp, "%s_bucket{le=\"+Inf\"} %lu\n", name, (unsigned long)cum[H_BUCKETS]);
+        fprintf(fp, "%s_sum %g\n%s_count %lu\n", name, sum * scale, name, (unsigned long)cum[H_BUCKETS]);
+}
+
+//전체 메트릭을 Prometheus 텍스트 형식으로 (HTTP 응답과 관리 콘솔)
+void metrics_write(FILE *fp) {
+        struct m_shard *s;
+        uint64_t v;
+        int i;
+
+        for(i = 0 ; i < M_COUNTERS ; i++) {
+                for(v = 0, s = __atomic_load_n(&shards, __ATOMIC_ACQUIRE) ; s != NULL ; s = s->next) {
+                        v += __atomic_load_n(&s->cnt[i], __ATOMIC_RELAXED);
+                }
+                fprintf(fp, "# HELP %s %s\n# TYPE %s counter\n%s %lu\n", cnt_names[i][0], cnt_names[i][1],
+                        cnt_names[i][0], cnt_names[i][0], (unsigned long)v);
+        }
+        LOCK(&scrape_lock);
+        for(i = 0 ; i < n_prep ; i++) {
+                preps[i]();
+        }
+        for(i = 0 ; i < n_func ; i++) {
+                fprintf(fp, "# HELP %s %s\n# TYPE %s %s\n%s %ld\n", funcs[i].name, funcs[i].help, funcs[i].name,
+                        funcs[i].type == MT_COUNTER ? "counter" : "gauge", funcs[i].name,
+                        funcs[i].fn != NULL ? funcs[i].fn() : __atomic_load_n(funcs[i].p, __ATOMIC_RELAXED));
+        }
+        UNLOCK(&scrape_lock);
+        write_hist(fp, H_LATENCY, "serv_relay_latency_seconds",
+                "Time from receiving a frame to writing it to a recipient", 1e-9, 10, 34);
+        write_hist(fp, H_FANOUT, "serv_fanout_recipients", "Recipients per relayed frame", 1, 0, 20);
+}
+
+//요청 하나에 응답 하나 (HTTP/1.0), 경로가 / 또는 /metrics가 아니면 404
+static void *metrics_loop(void *arg) {
+        struct timeval tv = { 1, 0 };
+        struct timespec ts = { 0, ACCEPT_BACKOFF_MS * 1000000L };
+        char req[REQ_MAX], hdr[128];
+        FILE *fp;
+        char *body;
+        size_t len;
+        int sock, n, ok;
+
+        while(1) {
+                sock = accept(m_sock, NULL, NULL);
+                if(sock == -1) {
+                        //EMFILE 등은 바로 다시 불러도 같은 에러라서 잠깐 쉼
+                        if(errno != EINTR && errno != ECONNABORTED) {
+                                nanosleep(&ts, NULL);
+                        }
+                        continue;
+                }
+                setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+                n = read(sock, req, sizeof(req) - 1);
+                if(n <= 0) {
+                        close(sock);
+                        continue;
+                }
+                req[n] = 0;
+                ok = !strncmp(req, "GET /metrics", 12) || !strncmp(req, "GET / ", 6);
+
+                body = NULL;
+                len = 0;
+                fp = open_memstream(&body, &len);
+                if(fp == NULL) {
+                        close(sock);
+                        continue;
+                }
+                if(ok) {
+                        metrics_write(fp);
+                } else {
+                        fprintf(fp, "not found\n");
+                }
+                fclose(fp);
+                n = snprintf(hdr, sizeof(hdr), "HTTP/1.0 %s\r\nContent-Type: text/plain; version=0.0.4\r\nContent-Length: %lu\r\n\r\n",
+                        ok ? "200 OK" : "404 Not Found", (unsigned long)len);
+                write_full(sock, hdr, n);
+                write_full(sock, body, len);
+                free(body);
+                close(sock);
+        }
+        return NULL;
+}
+
+//127.0.0.1:port에서 받음, 핫 리스타트 중에는 두 프로세스가 같이 바인드할 수 있게 SO_REUSEPORT
+int metrics_start(int port) {
+        struct sockaddr_in adr;
+        pthread_t t_id;
+        int on = 1;
+
+        m_sock = socket(PF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(m_sock == -1) {
+                return -1;
+        }
+        setsockopt(m_sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        setsockopt(m_sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on));
+        memset(&adr, 0, sizeof(adr));
+        adr.sin_family = AF_INET;
+        adr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        adr.sin_port = htons(port);
+        if(bind(m_sock, (struct sockaddr *)&adr, sizeof(adr)) == -1 || listen(m_sock, 16) == -1) {
+                close(m_sock);
+                m_sock = -1;
+                return -1;
+        }
+        if(pthread_create(&t_id, NULL, metrics_loop, NULL) != 0) {
+                return -1;
+        }
+        pthread_detach(t_id);
+        return 0;
+}
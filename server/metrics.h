@@ -0,0 +1,41 @@
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+//메트릭 : 카운터와 히스토그램은 스레드마다 따로 쌓고 (잠금, 원자적 RMW 없음) 읽을 때 합침
+//게이지는 읽을 때 콜백으로 계산, -M 포트로 Prometheus 텍스트 형식을 내보냄 (127.0.0.1만)
+
+//카운터
+#define M_ACCEPT 0              //받은 연결
+#define M_CLOSE 1               //닫힌 연결
+#define M_MSGS_IN 2
+#define M_BYTES_IN 3
+#define M_MSGS_OUT 4            //연결별로 보낸 메시지 (팬아웃 포함)
+#define M_BYTES_OUT 5
+#define M_RELAY 6               //전달한 메시지 (브로드캐스트 + DIRECT)
+#define M_COUNTERS 7
+
+//히스토그램 (HDR 방식 : 2의 거듭제곱 구간마다 H_SUB개로 나눔, 상대 오차 1/H_SUB 이하)
+#define H_LATENCY 0             //받은 뒤 상대 소켓(또는 공유 메모리 링)에 쓸 때까지 ns
+#define H_FANOUT 1              //메시지 1개를 받는 연결 수
+#define M_HISTS 2
+#define H_SUB_BITS 3
+#define H_SUB (1 << H_SUB_BITS)
+#define H_BUCKETS ((65 - H_SUB_BITS) * H_SUB)
+
+//게이지 종류
+#define MT_GAUGE 0
+#define MT_COUNTER 1            //다른 모듈이 이미 세고 있는 누적값
+
+int metrics_start(int port);
+void metrics_write(FILE *fp);
+void metric_func(char *name, char *help, int type, long (*fn)(void));
+void metric_long(char *name, char *help, int type, long *p);
+void metric_prep(void (*fn)(void));
+void metric_add(int i, long n);
+void metric_hist(int h, uint64_t v);
+uint64_t metric_ns(void);
+
+#endif
@@ -0,0 +1,483 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/epoll.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <sched.h>
+#include "serv.h"
+#include "conn.h"
+#include "log.h"
+#include "handoff.h"
+#include "worker.h"
+
+#define MAX_EVENTS 64
+
+//리액터 (epoll 인스턴스 + 스레드 1개)
+struct reactor {
+        int id;
+        int epfd;
+        int listen_sock;        //리슨 소켓이 없으면 -1
+        int unix_sock;          //UNIX 소켓 리스너 (0번 리액터만), 없으면 -1
+        int cpu;                //고정할 CPU, -1이면 고정 안 함
+        pthread_t t_id;
+        struct flushq fq;       //송신 큐에 메시지가 생긴 연결 목록
+        long next_flush;        //다음 flush 시각 (ms, conf.tick_ms > 0일 때)
+        struct wheel wheel;     //하트비트 타이머
+        int ho_phase;           //처리한 핫 리스타트 단계
+        int accept_more;        //리슨 소켓에 받을 연결이 남아 있을 수 있음
+        int unix_more;
+};
+
+//핫 리스타트 때 모으는 자기 연결 목록
+struct own_list {
+        struct reactor *r;
+        struct conn **v;
+        int n, cap;
+};
+
+static struct reactor *reactors;
+static int reactor_cnt;
+static int next_reactor = 0;
+
+static void *reactor_loop(void *arg);
+static int accept_clnt(struct reactor *r, int lsock);
+static void read_clnt(struct reactor *r, struct conn *c);
+static void shm_clnt(struct conn *c);
+static void flush_clnt(struct conn *c);
+static void reactor_handoff(struct reactor *r);
+
+//epoll 모드 실행
+//MODE_EPOLL : 리슨 소켓 1개를 0번 리액터가 accept해서 라운드 로빈 분배
+//MODE_REUSEPORT : 리액터마다 SO_REUSEPORT 리슨 소켓을 따로 갖고 자기 연결만 처리
+void run_epoll(void) {
+        struct epoll_event ev;
+        struct reactor *r;
+        struct conn *c;
+        int i;
+
+        reactor_cnt = conf.n_reactor;
+        reactors = calloc(reactor_cnt, sizeof(struct reactor));
+        if(reactors == NULL) {
+                error_handling("calloc() error");
+        }
+        //브로드캐스트는 공유 링에 한 번만 쓰고 연결마다 읽기 위치만 따라감
+        if(conf.bring_slots > 0) {
+                bring_init(conf.bring_slots);
+        }
+
+        for(i = 0 ; i < reactor_cnt ; i++) {
+                r = &reactors[i];
+                r->id = i;
+                r->listen_sock = -1;
+                r->unix_sock = -1;
+                r->cpu = reactor_cpu(i);
+                r->epfd = epoll_create1(EPOLL_CLOEXEC);
+                if(r->epfd == -1) {
+                        error_handling("epoll_create1() error");
+                }
+
+                flushq_init(&r->fq);
+                wheel_init(&r->wheel, now_ms());
+                handoff_add_wake(r->fq.efd);
+                memset(&ev, 0, sizeof(ev));
+                ev.events = EPOLLIN | EPOLLET;
+                ev.data.fd = r->fq.efd;
+                if(epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->fq.efd, &ev) == -1) {
+                        error_handling("epoll_ctl() error");
+                }
+
+                if(conf.mode == MODE_REUSEPORT) {
+                        r->listen_sock = open_listener(conf.port, 1);
+                } else if(i == 0) {
+                        //워커 프로세스는 accept 프로세스와의 채널을 리스너처럼 감시
+                        r->listen_sock = conf.chan != -1 ? conf.chan : open_listener(conf.port, 0);
+                }
+                if(r->listen_sock == -1) {
+                        continue;
+                }
+
+                if(set_nonblock(r->listen_sock) == -1) {
+                        error_handling("fcntl() error");
+                }
+                //커널이 이 CPU로 들어온 연결을 이 리스너에 우선 배정하도록 힌트
+                if(r->cpu != -1) {
+                        setsockopt(r->listen_sock, SOL_SOCKET, SO_INCOMING_CPU, &r->cpu, sizeof(r->cpu));
+                }
+
+                memset(&ev, 0, sizeof(ev));
+                ev.events = EPOLLIN | EPOLLET;
+                ev.data.fd = r->listen_sock;
+                if(epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->listen_sock, &ev) == -1) {
+                        error_handling("epoll_ctl() error");
+                }
+        }
+
+        //UNIX 소켓은 0번 리액터가 받음 (워커 프로세스는 accept 프로세스가 받아서 넘김)
+        if(conf.unix_path != NULL && conf.chan == -1) {
+                r = &reactors[0];
+                r->unix_sock = open_unix_listener(conf.unix_path);
+                if(set_nonblock(r->unix_sock) == -1) {
+                        error_handling("fcntl() error");
+                }
+                memset(&ev, 0, sizeof(ev));
+                ev.events = EPOLLIN | EPOLLET;
+                ev.data.fd = r->unix_sock;
+                if(epoll_ctl(r->epfd, EPOLL_CTL_ADD, r->unix_sock, &ev) == -1) {
+                        error_handling("epoll_ctl() error");
+                }
+        }
+
+        //핫 리스타트로 넘겨받은 연결은 라운드 로빈으로 배정
+        while((c = handoff_take()) != NULL) {
+                r = &reactors[next_reactor];
+                next_reactor = (next_reactor + 1) % reactor_cnt;
+                set_nonblock(c->fd);
+                if(flushq_add(&r->fq, c) == -1) {
+                        conn_close(c);
+                        continue;
+                }
+                //새 프로세스에서는 ID가 바뀜
+                conn_hello(c);
+
+                memset(&ev, 0, sizeof(ev));
+                ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                ev.data.fd = c->fd;
+                if(epoll_ctl(r->epfd, EPOLL_CTL_ADD, c->fd, &ev) == -1) {
+                        conn_close(c);
+                        continue;
+                }
+                conn_watch(c, &r->wheel);
+        }
+        handoff_serve();
+
+        for(i = 1 ; i < reactor_cnt ; i++) {
+                pthread_create(&reactors[i].t_id, NULL, reactor_loop, &reactors[i]);
+        }
+        LOG(LOG_INFO, EV_START, conf.mode, reactor_cnt, 0);
+
+        //0번 리액터는 메인 스레드에서 실행
+        reactors[0].t_id = pthread_self();
+        sig_wake_fd = reactors[0].fq.efd;
+        reactor_loop(&reactors[0]);
+}
+
+int set_nonblock(int fd) {
+        int flags = fcntl(fd, F_GETFL, 0);
+        if(flags == -1) {
+                return -1;
+        }
+        return fcntl(fd, F_SETFL, flags | O_NONBLOCK);
+}
+
+static void *reactor_loop(void *arg) {
+        struct reactor *r = (struct reactor *)arg;
+        struct epoll_event events[MAX_EVENTS];
+        cpu_set_t set;
+        struct conn *c;
+        uint64_t cnt, one = 1;
+        long wait;
+        int n, i, fd, timeout;
+
+        //소유 스레드는 루프 안에서 정함, 그 전에 다른 스레드가 깨우지 않고 넣은 연결은 첫 루프에서 flush
+        __atomic_store_n(&r->fq.owner, pthread_self(), __ATOMIC_RELEASE);
+        write(r->fq.efd, &one, sizeof(one));
+
+        if(r->cpu != -1) {
+                CPU_ZERO(&set);
+                CPU_SET(r->cpu, &set);
+                if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+                        fprintf(stderr, "reactor %d : cannot pin to cpu %d\n", r->id, r->cpu);
+                }
+        }
+
+        while(1) {
+                //타이머가 있으면 휠의 다음 tick까지, flush를 기다리는 연결이 있으면 다음 flush까지만 대기
+                timeout = wheel_timeout(&r->wheel, now_ms());
+                if(conf.tick_ms > 0 && flushq_pending(&r->fq)) {
+                        wait = r->next_flush - now_ms();
+                        if(wait < 0) {
+                                wait = 0;
+                        }
+                        if(timeout == -1 || wait < timeout) {
+                                timeout = wait;
+                        }
+                }
+                //받을 연결이 남았거나 spin 모드면 잠들지 않음
+                if(r->accept_more || r->unix_more || conf.lowlat == LL_SPIN) {
+                        timeout = 0;
+                }
+                n = epoll_wait(r->epfd, events, MAX_EVENTS, timeout);
+                if(n == -1) {
+                        if(errno == EINTR) {
+                                continue;
+                        }
+                        error_handling("epoll_wait() error");
+                }
+                wheel_run(&r->wheel, now_ms());
+
+                for(i = 0 ; i < n ; i++) {
+                        fd = events[i].data.fd;
+                        //새 연결은 기존 연결의 이벤트를 다 처리한 뒤에 받음
+                        if(fd == r->listen_sock) {
+                                r->accept_more = 1;
+                                continue;
+                        }
+                        if(fd == r->unix_sock) {
+                                r->unix_more = 1;
+                                continue;
+                        }
+                        if(fd == r->fq.efd) {
+                                read(fd, &cnt, sizeof(cnt));
+                                continue;
+                        }
+                        c = conn_get(fd);
+                        if(c == NULL) {
+                                continue;
+                        }
+                        //공유 메모리 연결의 eventfd
+                        if(c->shm != NULL && fd == c->shm->wake_fd) {
+                                shm_clnt(c);
+                                continue;
+                        }
+                        //다른 리액터가 accept한 연결이므로 처음 이벤트를 받을 때 자기 휠에 등록
+                        if(c->wheel == NULL) {
+                                conn_watch(c, &r->wheel);
+                        }
+                        if(events[i].events & EPOLLOUT) {
+                                flush_clnt(c);
+                        }
+                        if(!c->closed && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))) {
+                                read_clnt(r, c);
+                        }
+                }
+
+                if(r->accept_more) {
+                        r->accept_more = r->listen_sock != -1 && accept_clnt(r, r->listen_sock);
+                }
+                if(r->unix_more) {
+                        r->unix_more = r->unix_sock != -1 && accept_clnt(r, r->unix_sock);
+                }
+
+                //tick 동안 (tick이 0이면 이번 루프 동안) 메시지가 쌓인 연결을 한 번에 flush
+                if(conf.tick_ms == 0 || now_ms() >= r->next_flush) {
+                        flushq_drain(&r->fq, flush_clnt);
+                        r->next_flush = now_ms() + conf.tick_ms;
+                }
+
+                if(r->ho_phase != handoff_phase) {
+                        r->ho_phase = handoff_phase;
+                        reactor_handoff(r);
+                }
+
+                if(dump_req && __atomic_exchange_n(&dump_req, 0, __ATOMIC_RELAXED)) {
+                        bp_dump();
+                }
+        }
+        return NULL;
+}
+
+//엣지 트리거이므로 EAGAIN이 나올 때까지 accept
+//접속이 몰려도 기존 연결이 밀리지 않도록 루프 1회에 ACCEPT_BATCH개까지만 받고, 남았을 수 있으면 1
+static int accept_clnt(struct reactor *lr, int lsock) {
+        struct sockaddr_in clnt_adr;
+        socklen_t clnt_adr_sz;
+        struct epoll_event ev;
+        struct reactor *r;
+        struct conn *c;
+        int clnt_sock, i, reason;
+        long retry;
+
+        for(i = 0 ; i < ACCEPT_BATCH ; i++) {
+                clnt_adr_sz = sizeof(clnt_adr);
+                if(conf.chan != -1) {
+                        clnt_sock = chan_recv(lsock, &clnt_adr);
+                        if(clnt_sock != -1) {
+                                set_nonblock(clnt_sock);
+                        }
+                } else {
+                        clnt_sock = accept4(lsock, (struct sockaddr*)&clnt_adr, &clnt_adr_sz,
+                                SOCK_NONBLOCK | SOCK_CLOEXEC);
+                }
+                if(clnt_sock == -1) {
+                        if(errno == EINTR || errno == ECONNABORTED) {
+                                continue;
+                        }
+                        return 0;
+                }
+                if(lsock == lr->unix_sock) {
+                        unix_peer(&clnt_adr);
+                }
+
+                //한계를 넘으면 바로 BUSY를 보내고 닫음 (워커 프로세스는 accept 프로세스가 이미 확인)
+                if(conf.chan == -1 && (retry = conn_admit(conn_count(), &reason)) > 0) {
+                        conn_reject(clnt_sock, &clnt_adr, reason, retry);
+                        continue;
+                }
+
+                //reuseport면 받은 리액터가 소유, 아니면 라운드 로빈으로 배정
+                if(conf.mode == MODE_REUSEPORT) {
+                        r = lr;
+                } else {
+                        r = &reactors[next_reactor];
+                        next_reactor = (next_reactor + 1) % reactor_cnt;
+                }
+
+                c = conn_new(clnt_sock, &r->fq, &clnt_adr);
+                if(c == NULL) {
+                        close(clnt_sock);
+                        continue;
+                }
+                conn_hello(c);
+
+                memset(&ev, 0, sizeof(ev));
+                ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+                ev.data.fd = clnt_sock;
+                if(epoll_ctl(r->epfd, EPOLL_CTL_ADD, clnt_sock, &ev) == -1) {
+                        conn_close(c);
+                        continue;
+                }
+                LOG(LOG_INFO, EV_CONNECT, c->id, clnt_adr.sin_addr.s_addr, r->id);
+        }
+        return 1;
+}
+
+//공유 메모리 전환 요청 처리, 전환했으면 eventfd를 감시 (연결을 닫아야 하면 -1)
+static int start_shm(struct reactor *r, struct conn *c) {
+        struct epoll_event ev;
+        int ret = conn_shm(c, 1);
+
+        if(ret != 0) {
+                return ret == -1 ? -1 : 0;
+        }
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.fd = c->shm->wake_fd;
+        return epoll_ctl(r->epfd, EPOLL_CTL_ADD, c->shm->wake_fd, &ev);
+}
+
+//읽을 수 있는 데이터를 모두 읽고 완성된 프레임마다 전달
+static void read_clnt(struct reactor *r, struct conn *c) {
+        ssize_t str_len;
+
+        while(1) {
+                str_len = frame_ring_read(&c->rx, c->fd);
+                if(str_len > 0) {
+                        if(conn_drain_rx(c) == -1) {
+                                break;
+                        }
+                        if(c->shm_req && start_shm(r, c) == -1) {
+                                break;
+                        }
+                } else if(str_len == -1 && errno == EINTR) {
+                        continue;
+                } else if(str_len == -1 && errno == EAGAIN) {
+                        return;
+                } else {
+                        break;
+                }
+        }
+        conn_close(c);
+}
+
+//공유 메모리 연결 : 상대가 링에 썼거나, 가득 찼던 송신 링에 자리가 생김
+//소켓은 계속 epoll에 있으므로 상대가 끊으면 read_clnt가 닫음
+static void shm_clnt(struct conn *c) {
+        unsigned room;
+        ssize_t n;
+        char *p;
+
+        shm_woken(c->shm);
+        flush_clnt(c);
+        if(c->closed) {
+                return;
+        }
+        while(1) {
+                p = frame_ring_space(&c->rx, &room);
+                if(p == NULL) {
+                        break;
+                }
+                n = shm_read(c->shm, p, room);
+                if(n == -1) {
+                        //클라이언트가 링 인덱스를 망가뜨림
+                        break;
+                }
+                if(n > 0) {
+                        frame_ring_commit(&c->rx, n);
+                        if(conn_drain_rx(c) == -1) {
+                                break;
+                        }
+                        continue;
+                }
+                //잠들기 직전에 들어온 데이터가 있으면 계속 읽음
+                if(shm_sleep(c->shm)) {
+                        return;
+                }
+        }
+        conn_close(c);
+}
+
+//EAGAIN이면 EPOLLOUT(엣지)이 올 때 다시 호출됨
+static void flush_clnt(struct conn *c) {
+        if(c->kill || conn_flush(c) == -1) {
+                conn_close(c);
+        }
+}
+
+static void collect_own(struct conn *c, void *arg) {
+        struct own_list *own = (struct own_list *)arg;
+        struct conn **v;
+
+        if(c->fq != &own->r->fq) {
+                return;
+        }
+        if(own->n == own->cap) {
+                own->cap = own->cap ? own->cap * 2 : 64;
+                v = realloc(own->v, sizeof(struct conn *) * own->cap);
+                if(v == NULL) {
+                        own->cap = own->n;
+                        return;
+                }
+                own->v = v;
+        }
+        conn_hold(c);
+        own->v[own->n++] = c;
+}
+
+//핫 리스타트 : HO_STOP이면 accept 중단, HO_MOVE면 자기 연결을 후임 프로세스로 넘김
+static void reactor_handoff(struct reactor *r) {
+        struct own_list own = { r, NULL, 0, 0 };
+        struct conn *c;
+        int i;
+
+        //후임도 같은 소켓을 갖고 있으므로 close만으로는 epoll에서 빠지지 않음
+        if(r->ho_phase == HO_STOP && r->listen_sock != -1) {
+                epoll_ctl(r->epfd, EPOLL_CTL_DEL, r->listen_sock, NULL);
+                close(r->listen_sock);
+                r->listen_sock = -1;
+                if(r->unix_sock != -1) {
+                        epoll_ctl(r->epfd, EPOLL_CTL_DEL, r->unix_sock, NULL);
+                        close(r->unix_sock);
+                        r->unix_sock = -1;
+                }
+        } else if(r->ho_phase == HO_MOVE) {
+                conn_foreach(collect_own, &own);
+                for(i = 0 ; i < own.n ; i++) {
+                        c = own.v[i];
+                        //넘기지 못한 연결은 이 프로세스가 끝날 때까지 계속 처리
+                        if(!c->closed && handoff_conn(c) == 0) {
+                                epoll_ctl(r->epfd, EPOLL_CTL_DEL, c->fd, NULL);
+                                conn_close(c);
+                        }
+                        conn_put(c);
+                }
+                free(own.v);
+        }
+        handoff_done();
+}
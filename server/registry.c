@@ -0,0 +1,142 @@
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "conn.h"
+#include "registry.h"
+#include "lockstat.h"
+
+struct reg_ent {
+        unsigned hash;
+        unsigned id;
+        struct reg_ent *next;
+        char name[NAME_SIZE];
+};
+
+static struct reg_ent **buckets;
+static unsigned n_bucket, n_ent;
+static pthread_mutex_t reg_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static unsigned name_hash(char *name);
+static struct reg_ent **find(char *name, unsigned hash);
+static void grow(void);
+
+//FNV-1a
+static unsigned name_hash(char *name) {
+        unsigned h = 2166136261U;
+
+        while(*name) {
+                h ^= (unsigned char)*name++;
+                h *= 16777619U;
+        }
+        return h;
+}
+
+//이름이 있는 칸 (없으면 체인 끝의 NULL 칸), reg_lock 안에서 호출
+static struct reg_ent **find(char *name, unsigned hash) {
+        struct reg_ent **p = &buckets[hash & (n_bucket - 1)];
+
+        for( ; *p != NULL ; p = &(*p)->next) {
+                if((*p)->hash == hash && !strcmp((*p)->name, name)) {
+                        break;
+                }
+        }
+        return p;
+}
+
+//버킷 수를 두 배로 (실패하면 체인이 길어진 채로 계속 사용)
+static void grow(void) {
+        struct reg_ent **tab, *e, *next;
+        unsigned i, cap = n_bucket * 2;
+
+        tab = calloc(cap, sizeof(struct reg_ent *));
+        if(tab == NULL) {
+                return;
+        }
+        for(i = 0 ; i < n_bucket ; i++) {
+                for(e = buckets[i] ; e != NULL ; e = next) {
+                        next = e->next;
+                        e->next = tab[e->hash & (cap - 1)];
+                        tab[e->hash & (cap - 1)] = e;
+                }
+        }
+        free(buckets);
+        buckets = tab;
+        n_bucket = cap;
+}
+
+//이름을 id 연결에 등록 : 0 = 등록함, -1 = 다른 연결이 쓰는 중이거나 메모리 부족
+//이미 닫힌 연결이 남긴 항목은 덮어씀
+int name_claim(char *name, unsigned id) {
+        unsigned hash = name_hash(name);
+        struct reg_ent **p, *e;
+        int ret = 0;
+
+        LOCK(&reg_lock);
+        if(buckets == NULL) {
+                buckets = calloc(REG_INIT, sizeof(struct reg_ent *));
+                if(buckets == NULL) {
+                        UNLOCK(&reg_lock);
+                        return -1;
+                }
+                n_bucket = REG_INIT;
+        }
+        p = find(name, hash);
+        if(*p != NULL) {
+                if((*p)->id != id && conn_by_id((*p)->id) != NULL) {
+                        ret = -1;
+                } else {
+                        (*p)->id = id;
+                }
+        } else if((e = malloc(sizeof(*e))) == NULL) {
+                ret = -1;
+        } else {
+                e->hash = hash;
+                e->id = id;
+                e->next = NULL;
+                strncpy(e->name, name, NAME_SIZE - 1);
+                e->name[NAME_SIZE - 1] = 0;
+                *p = e;
+                if(++n_ent > n_bucket) {
+                        grow();
+                }
+        }
+        UNLOCK(&reg_lock);
+        return ret;
+}
+
+//id가 등록한 이름이면 지움 (그 사이 다른 연결이 가져갔으면 그대로 둠)
+void name_release(char *name, unsigned id) {
+        unsigned hash = name_hash(name);
+        struct reg_ent **p, *e;
+
+        LOCK(&reg_lock);
+        if(buckets != NULL && *(p = find(name, hash)) != NULL && (*p)->id == id) {
+                e = *p;
+                *p = e->next;
+                free(e);
+                n_ent--;
+        }
+        UNLOCK(&reg_lock);
+}
+
+//이름을 쓰는 연결의 id, 없으면 0
+unsigned name_lookup(char *name) {
+        unsigned hash = name_hash(name), id = 0;
+        struct reg_ent **p;
+
+        LOCK(&reg_lock);
+        if(buckets != NULL && *(p = find(name, hash)) != NULL) {
+                id = (*p)->id;
+        }
+        UNLOCK(&reg_lock);
+        return id;
+}
+
+int name_count(void) {
+        int n;
+
+        LOCK(&reg_lock);
+        n = n_ent;
+        UNLOCK(&reg_lock);
+        return n;
+}
@@ -0,0 +1,14 @@
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+//이름 -> 세션 ID 해시 테이블 (ID -> 연결은 conn_by_id)
+//로그인할 때 등록하고 연결이 닫힐 때 지움, 같은 이름은 살아 있는 연결 하나만 가질 수 있음
+
+#define REG_INIT 1024           //처음 버킷 수 (2의 거듭제곱), 항목 수가 버킷 수를 넘으면 두 배로
+
+int name_claim(char *name, unsigned id);
+void name_release(char *name, unsigned id);
+unsigned name_lookup(char *name);
+int name_count(void);
+
+#endif
@@ -1,64 +1,356 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <arpa/inet.h>
 #include <sys/socket.h>
+#include <sys/un.h>
 #include <sys/time.h>
 #include <sys/select.h>
 #include <pthread.h>
 #include <string.h>
-
-#define BUF_SIZE 100
-#define MAX_CLNT 256
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <sys/eventfd.h>
+#include <netinet/tcp.h>
+#include <sched.h>
+#include "serv.h"
+#include "conn.h"
+#include "log.h"
+#include "handoff.h"
+#include "worker.h"
+#include "metrics.h"
+#include "admin.h"
+#include "../common/trace.h"
 
 void *handle_clnt(void *arg);
-void send_msg(char *msg, int len);
-void error_handling(char *buf);
+void usage(char *name);
+int parse_cpus(char *str);
+int parse_hwm(char *str);
+int parse_batch(char *str);
+int parse_log(char *str);
+int parse_hb(char *str);
+int parse_workers(char *str);
+int parse_admit(char *str);
+int parse_lowlat(char *str);
+void on_sigusr1(int sig);
+static void set_rcvtimeo(int fd, int ms);
+
+//서버 설정
+struct serv_conf conf;
 
-//소켓 세팅
-int clnt_cnt = 0;
-int clnt_socks[MAX_CLNT];
-pthread_mutex_t mutx;
+//SIGUSR1을 받으면 리액터가 통계를 출력
+volatile int dump_req = 0;
+int sig_wake_fd = -1;           //0번 리액터의 eventfd (스레드 모드는 accept 루프)
 
 int main(int argc, char *argv[]) {
         
-        int serv_sock, clnt_sock;
-        struct sockaddr_in serv_adr, clnt_adr;
+        int serv_sock, clnt_sock, unix_sock = -1, lsock;
+        struct sockaddr_in clnt_adr;
         socklen_t clnt_adr_sz;
         pthread_t t_id;
-        if(argc != 2) {
-                printf("Usage : %s <port>\n", argv[0]);
-                exit(1);
+        struct conn *c;
+        struct pollfd pfd[3];
+        uint64_t cnt;
+        int opt, wake_fd, ho_phase = HO_NONE, t_set = 0, reason, n;
+        long retry;
+        char admin_path[108];
+
+        conf.mode = MODE_EPOLL;
+        conf.n_reactor = sysconf(_SC_NPROCESSORS_ONLN);
+        conf.n_cpu = 0;
+        conf.hwm_bytes = 256 * 1024;
+        conf.hwm_msgs = 1024;
+        conf.bp_policy = BP_DROP;
+        conf.pool_size = 1024;
+        conf.batch = IOV_BATCH;
+        conf.tick_ms = 0;
+        conf.log_path = "-";
+        conf.log_level = LOG_INFO;
+        conf.log_sample = 1;
+        conf.hb_idle = 15000;
+        conf.hb_timeout = 45000;
+        conf.restart_path = NULL;
+        conf.n_worker = 0;
+        conf.worker_policy = WP_MATCH;
+        conf.chan = -1;
+        conf.worker_id = -1;
+        memset(conf.rl, 0, sizeof(conf.rl));
+        conf.rl_action = RL_DROP;
+        conf.backlog = SOMAXCONN;
+        conf.max_conn = 0;
+        conf.accept_rate = 0;
+        conf.lowlat = LL_OFF;
+        conf.busy_poll_us = 0;
+        conf.unix_path = NULL;
+        conf.bring_slots = BRING_SLOTS;
+        conf.metrics_port = 0;
+        conf.admin_path = NULL;
+
+        while((opt = getopt(argc, argv, "m:t:a:w:p:c:b:l:k:r:P:q:A:L:u:B:M:C:")) != -1) {
+                switch(opt) {
+                case 'm':
+                        if(!strcmp(optarg, "thread")) {
+                                conf.mode = MODE_THREAD;
+                        } else if(!strcmp(optarg, "epoll")) {
+                                conf.mode = MODE_EPOLL;
+                        } else if(!strcmp(optarg, "reuseport")) {
+                                conf.mode = MODE_REUSEPORT;
+                        } else if(!strcmp(optarg, "uring")) {
+                                conf.mode = MODE_URING;
+                        } else {
+                                usage(argv[0]);
+                        }
+                        break;
+                case 't':
+                        conf.n_reactor = atoi(optarg);
+                        t_set = 1;
+                        break;
+                case 'a':
+                        if(parse_cpus(optarg) == -1) {
+                                usage(argv[0]);
+                        }
+                        break;
+                case 'w':
+                        if(parse_hwm(optarg) == -1) {
+                                usage(argv[0]);
+                        }
+                        break;
+                case 'p':
+                        if(!strcmp(optarg, "drop")) {
+                                conf.bp_policy = BP_DROP;
+                        } else if(!strcmp(optarg, "coalesce")) {
+                                conf.bp_policy = BP_COALESCE;
+                        } else if(!strcmp(optarg, "disconnect")) {
+                                conf.bp_policy = BP_DISCONNECT;
+                        } else {
+                                usage(argv[0]);
+                        }
+                        break;
+                case 'c':
+                        conf.pool_size = atoi(optarg);
+                        break;
+                case 'b':
+                        if(parse_batch(optarg) == -1) {
+                                usage(argv[0]);
+                        }
+                        break;
+                case 'l':
+                        if(parse_log(optarg) == -1) {
+                                usage(argv[0]);
+                        }
+                        break;
+                case 'k':
+                        if(parse_hb(optarg) == -1) {
+                                usage(argv[0]);
+                        }
+                        break;
+                case 'r':
+                        conf.restart_path = optarg;
+                        break;
+                case 'P':
+                        if(parse_workers(optarg) == -1) {
+                                usage(argv[0]);
+                        }
+                        break;
+                case 'q':
+                        if(parse_limit(optarg) == -1) {
+                                usage(argv[0]);
+                        }
+                        break;
+                case 'A':
+                        if(parse_admit(optarg) == -1) {
+                                usage(argv[0]);
+                        }
+                        break;
+                case 'L':
+                        if(parse_lowlat(optarg) == -1) {
+                                usage(argv[0]);
+                        }
+                        break;
+                case 'u':
+                        conf.unix_path = optarg;
+                        break;
+                case 'B':
+                        conf.bring_slots = atoi(optarg);
+                        //0은 끔, 나머지는 2의 거듭제곱만
+                        if(conf.bring_slots < 0 || (conf.bring_slots & (conf.bring_slots - 1)) != 0 ||
+                                (conf.bring_slots > 0 && conf.bring_slots < BRING_MIN)) {
+                                usage(argv[0]);
+                        }
+                        break;
+                case 'M':
+                        conf.metrics_port = atoi(optarg);
+                        if(conf.metrics_port <= 0 || conf.metrics_port > 65535) {
+                                usage(argv[0]);
+                        }
+                        break;
+                case 'C':
+                        conf.admin_path = optarg;
+                        break;
+                default:
+                        usage(argv[0]);
+                }
+        }
+        if(optind != argc - 1 || conf.n_reactor < 1 || (conf.n_worker > 0 && conf.restart_path != NULL)) {
+                usage(argv[0]);
         }
+        conf.port = atoi(argv[optind]);
 
-        pthread_mutex_init(&mutx, NULL);
-        serv_sock = socket(PF_INET, SOCK_STREAM, 0);
+        //저지연 모드에서 -a가 없으면 모든 CPU를 차례로 사용
+        if(conf.lowlat != LL_OFF && conf.n_cpu == 0) {
+                for(conf.n_cpu = 0 ; conf.n_cpu < sysconf(_SC_NPROCESSORS_ONLN) && conf.n_cpu < MAX_CPUS ; conf.n_cpu++) {
+                        conf.cpus[conf.n_cpu] = conf.n_cpu;
+                }
+        }
 
-        memset(&serv_adr, 0, sizeof(serv_adr));
-        serv_adr.sin_family = AF_INET;
-        serv_adr.sin_addr.s_addr = htonl(INADDR_ANY);
-        serv_adr.sin_port = htons(atoi(argv[1]));
+        //끊긴 소켓에 쓸 때 프로세스가 죽지 않도록
+        signal(SIGPIPE, SIG_IGN);
+        signal(SIGUSR1, on_sigusr1);
 
-        if(bind(serv_sock, (struct sockaddr*)&serv_adr, sizeof(serv_adr)) == -1) {
-                error_handling("bind() error");
+        //멀티 프로세스 모드 : 이 프로세스는 accept만 하고, fork된 워커만 아래로 진행
+        if(conf.n_worker > 0) {
+                run_acceptor();
+                //워커가 여러 개면 리액터는 기본 1개 (코어는 워커 프로세스로 나눔)
+                if(!t_set) {
+                        conf.n_reactor = 1;
+                }
+                //채널은 1개이므로 리스너를 나누는 reuseport는 의미 없음
+                if(conf.mode == MODE_REUSEPORT) {
+                        conf.mode = MODE_EPOLL;
+                }
+                //io_uring은 받은 링에서만 recv를 걸 수 있어서 링 1개
+                if(conf.mode == MODE_URING) {
+                        conf.n_reactor = 1;
+                }
+        }
+        if(log_init(conf.log_path, conf.log_level, conf.log_sample) == -1) {
+                error_handling("log_init() error");
+        }
+        conn_init(conf.pool_size);
+        if(conf.chan != -1) {
+                worker_init();
+        }
+        //워커 프로세스는 각자 port + 워커 번호로 내보냄
+        if(conf.metrics_port > 0 && metrics_start(conf.metrics_port + (conf.worker_id > 0 ? conf.worker_id : 0)) == -1) {
+                error_handling("metrics_start() error");
+        }
+        if(conf.admin_path != NULL) {
+                //워커 프로세스는 각자 path.워커번호
+                if(conf.worker_id >= 0) {
+                        snprintf(admin_path, sizeof(admin_path), "%s.%d", conf.admin_path, conf.worker_id);
+                        conf.admin_path = admin_path;
+                }
+                if(admin_start(conf.admin_path) == -1) {
+                        error_handling("admin_start() error");
+                }
         }
 
-        if(listen(serv_sock, 5) == -1) {
-                error_handling("listen() error");
+        //핫 리스타트 : 이전 프로세스가 있으면 리슨 소켓과 연결을 넘겨받음
+        if(conf.restart_path != NULL && handoff_recv(conf.restart_path) == -1) {
+                error_handling("hot restart handoff error");
+        }
+
+        //io_uring 모드, 지원하지 않는 커널이면 epoll로 대체
+        if(conf.mode == MODE_URING && run_uring() == -1) {
+                conf.mode = conf.n_reactor > 1 ? MODE_REUSEPORT : MODE_EPOLL;
         }
 
+        //epoll 리액터 모드
+        if(conf.mode == MODE_EPOLL || conf.mode == MODE_REUSEPORT) {
+                run_epoll();
+                return 0;
+        }
+
+        //워커 프로세스는 리스너 대신 채널에서 연결을 받음
+        serv_sock = conf.chan != -1 ? conf.chan : open_listener(conf.port, 0);
+        if(conf.unix_path != NULL && conf.chan == -1) {
+                unix_sock = open_unix_listener(conf.unix_path);
+        }
+        wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if(wake_fd == -1) {
+                error_handling("eventfd() error");
+        }
+        handoff_add_wake(wake_fd);
+        sig_wake_fd = wake_fd;
+
+        //넘겨받은 연결 (epoll 모드에서 넘어왔으면 논블로킹이므로 되돌림)
+        while((c = handoff_take()) != NULL) {
+                fcntl(c->fd, F_SETFL, fcntl(c->fd, F_GETFL, 0) & ~O_NONBLOCK);
+                pthread_create(&t_id, NULL, handle_clnt, (void *)c);
+                pthread_detach(t_id);
+        }
+        handoff_serve();
+        LOG(LOG_INFO, EV_START, MODE_THREAD, 0, 0);
+
+        //스레드 모드 (클라이언트당 스레드 1개)
         while(1) {
+                //accept는 다른 스레드가 깨울 수 없으므로 핫 리스타트 알림과 같이 poll
+                pfd[0].fd = serv_sock;
+                pfd[0].events = POLLIN;
+                pfd[1].fd = wake_fd;
+                pfd[1].events = POLLIN;
+                pfd[2].fd = unix_sock;
+                pfd[2].events = POLLIN;
+                n = poll(pfd, 3, -1);
+                //SIGUSR1 통계 출력
+                if(dump_req && __atomic_exchange_n(&dump_req, 0, __ATOMIC_RELAXED)) {
+                        bp_dump();
+                }
+                if(n <= 0) {
+                        continue;
+                }
+                if(pfd[1].revents) {
+                        read(wake_fd, &cnt, sizeof(cnt));
+                        if(ho_phase != handoff_phase) {
+                                ho_phase = handoff_phase;
+                                //리슨 소켓을 닫고, 기존 연결은 끝날 때까지 스레드가 계속 처리
+                                if(ho_phase == HO_STOP) {
+                                        close(serv_sock);
+                                        serv_sock = -1;
+                                        if(unix_sock != -1) {
+                                                close(unix_sock);
+                                                unix_sock = -1;
+                                        }
+                                }
+                                handoff_done();
+                        }
+                        continue;
+                }
+
                 clnt_adr_sz = sizeof(clnt_adr);
-                clnt_sock = accept(serv_sock, (struct sockaddr*)&clnt_adr, &clnt_adr_sz);
+                lsock = pfd[0].revents ? serv_sock : unix_sock;
+                if(conf.chan != -1) {
+                        clnt_sock = chan_recv(serv_sock, &clnt_adr);
+                } else {
+                        clnt_sock = accept4(lsock, (struct sockaddr*)&clnt_adr, &clnt_adr_sz, SOCK_CLOEXEC);
+                }
+                if(clnt_sock == -1) {
+                        continue;
+                }
+                if(lsock == unix_sock) {
+                        unix_peer(&clnt_adr);
+                }
+                //한계를 넘으면 스레드를 만들지 않고 바로 BUSY를 보내고 닫음
+                if(conf.chan == -1 && (retry = conn_admit(conn_count(), &reason)) > 0) {
+                        conn_reject(clnt_sock, &clnt_adr, reason, retry);
+                        continue;
+                }
 
-                pthread_mutex_lock(&mutx);
-                clnt_socks[clnt_cnt++] = clnt_sock;
-                pthread_mutex_unlock(&mutx);
+                c = conn_new(clnt_sock, NULL, &clnt_adr);
+                if(c == NULL) {
+                        close(clnt_sock);
+                        continue;
+                }
 
-                pthread_create(&t_id, NULL, handle_clnt, (void *)&clnt_sock);
+                pthread_create(&t_id, NULL, handle_clnt, (void *)c);
                 pthread_detach(t_id);
-                printf("Connected client IP : %s\n", inet_ntoa(clnt_adr.sin_addr));
+                LOG(LOG_INFO, EV_CONNECT, c->id, clnt_adr.sin_addr.s_addr, 0);
         }
 
         close(serv_sock);
@@ -66,39 +358,448 @@ int main(int argc, char *argv[]) {
 }
 //클라이언트 핸들링
 void *handle_clnt(void *arg) {
-        int clnt_sock = *((int*)arg);
-        int str_len = 0, i;
-        char msg[BUF_SIZE];
+        struct conn *c = (struct conn *)arg;
+        struct frame f;
+        long last_rx = now_ms();
+        ssize_t n;
+        int ret = 0, pinged = 0, lim = 0, i;
+        char shm_no[FRAME_HDR_MAX + sizeof(struct proto_shm)];
+        char hello[FRAME_HDR_MAX + sizeof(struct proto_hello)];
+        char ack[FRAME_HDR_MAX + sizeof(struct proto_login_ack)];
+        cpu_set_t set;
 
-        while((str_len = read(clnt_sock, msg, sizeof(msg))) != 0) {
-                send_msg(msg, str_len);
-                memset(msg, 0, sizeof(msg));
+        //CPU 목록이 있으면 클라이언트 스레드도 fd 기준으로 나눠서 고정
+        if(conf.n_cpu > 0) {
+                CPU_ZERO(&set);
+                CPU_SET(reactor_cpu(c->fd), &set);
+                pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
         }
 
-        pthread_mutex_lock(&mutx);
-        for(i = 0 ; i < clnt_cnt ; i++) {
-                if(clnt_sock == clnt_socks[i]) {
-                        while(i++ < clnt_cnt - 1) {
-                                clnt_socks[i]  = clnt_socks[i + 1];
+        //스레드 모드는 타이머 휠 대신 수신 타임아웃으로 하트비트
+        set_rcvtimeo(c->fd, conf.hb_idle);
+
+        //세션 ID를 먼저 알려줌
+        i = frame_hdr(hello, FT_HELLO, sizeof(struct proto_hello));
+        i += proto_hello_enc(hello + i, c->id);
+        conn_write(c, hello, i);
+
+        //프레임 단위로 꺼내서 헤더째로 전달
+        while(1) {
+                n = frame_ring_read(&c->rx, c->fd);
+                if(n == -1 && (errno == EAGAIN || errno == EWOULDBLOCK) && conf.hb_idle > 0) {
+                        if(pinged) {
+                                LOG(LOG_WARN, EV_TIMEOUT, c->id, now_ms() - last_rx, 0);
+                                break;
                         }
+                        //PING을 보내고 남은 시간만큼 응답을 기다림
+                        conn_write(c, "\0\3", 2);
+                        set_rcvtimeo(c->fd, conf.hb_timeout - conf.hb_idle);
+                        pinged = 1;
+                        continue;
+                }
+                if(n <= 0) {
+                        break;
+                }
+                if(pinged) {
+                        set_rcvtimeo(c->fd, conf.hb_idle);
+                        pinged = 0;
+                }
+                last_rx = now_ms();
+
+                while((ret = frame_ring_next(&c->rx, &f)) == 1) {
+                        c->st.msgs_in++;
+                        c->st.bytes_in += f.raw_len;
+                        metric_add(M_MSGS_IN, 1);
+                        metric_add(M_BYTES_IN, f.raw_len);
+                        TRACE3(serv, frame, c->id, f.type, f.len);
+                        //속도 제한을 넘으면 버리거나 연결 종료
+                        if((lim = conn_limit(c, &f, now_ms())) == -1) {
+                                break;
+                        } else if(lim == 1) {
+                                continue;
+                        }
+                        //PING/PONG은 전달하지 않음
+                        if(f.type == FT_PING) {
+                                conn_write(c, "\0\4", 2);
+                                continue;
+                        } else if(f.type == FT_PONG) {
+                                continue;
+                        } else if(f.type == FT_SHM) {
+                                //스레드 모드는 공유 메모리로 전환하지 않음, 계속 소켓 사용
+                                i = frame_hdr(shm_no, FT_SHM, sizeof(struct proto_shm));
+                                i += proto_shm_enc(shm_no + i, 0, 0);
+                                conn_write(c, shm_no, i);
+                                continue;
+                        } else if(f.type == FT_LOGIN) {
+                                i = conn_login(c, &f, ack);
+                                conn_write(c, ack, i);
+                                continue;
+                        } else if(f.type == FT_DIRECT) {
+                                if(conn_direct(c, &f) == -1) {
+                                        LOG(LOG_WARN, EV_BADFRAME, c->id, f.type, 0);
+                                }
+                                continue;
+                        }
+                        proto_stamp(f.type, f.data, f.len, c->id);
+                        send_msg(c, f.type, f.raw, f.raw_len);
+                        LOG(LOG_INFO, EV_RELAY, c->id, f.type, f.len);
+                }
+                if(lim == -1) {
+                        break;
+                }
+                if(ret == -1) {
+                        LOG(LOG_WARN, EV_BADFRAME, c->id, 0, 0);
                         break;
                 }
         }
 
-        clnt_cnt--;
-        pthread_mutex_unlock(&mutx);
-        close(clnt_sock);
+        conn_close(c);
         return NULL;
 }
-//Log 메세지 확인
-void send_msg(char *msg, int len) {
+
+struct raw_msg {
+        struct conn *from;
+        char *msg;
+        int len;
+        uint64_t ts;            //받은 시각 (전달 지연 측정)
+        int n;                  //보낸 연결 수
+};
+
+static void write_one(struct conn *c, void *arg) {
+        struct raw_msg *m = (struct raw_msg *)arg;
+
+        if(c != m->from && conn_write(c, m->msg, m->len) == m->len) {
+                TRACE2(serv, write, c->id, m->len);
+                TRACE2(serv, deliver, c->id, m->ts);
+                metric_add(M_MSGS_OUT, 1);
+                metric_add(M_BYTES_OUT, m->len);
+                metric_hist(H_LATENCY, metric_ns() - m->ts);
+                m->n++;
+        }
+}
+//보낸 연결을 뺀 모두에게 전달
+void send_msg(struct conn *from, int type, char *msg, int len) {
+        struct raw_msg m;
+
+        m.from = from;
+        m.msg = msg;
+        m.len = len;
+        m.ts = metric_ns();
+        m.n = 0;
+        TRACE3(serv, fanout_start, from->id, type, m.ts);
+        //블로킹 쓰기라서 샤드 잠금 밖에서
+        conn_fanout(write_one, &m);
+        TRACE2(serv, fanout_end, from->id, m.n);
+        metric_add(M_RELAY, 1);
+        metric_hist(H_FANOUT, m.n);
+}
+
+//리슨 소켓 생성 (reuseport면 같은 포트에 여러 개 바인드 가능)
+int open_listener(int port, int reuseport) {
+        int serv_sock, on = 1;
+        struct sockaddr_in serv_adr;
+
+        //핫 리스타트로 넘겨받은 리슨 소켓이 있으면 그대로 사용
+        serv_sock = handoff_listener();
+        if(serv_sock != -1) {
+                handoff_keep(serv_sock);
+                return serv_sock;
+        }
+
+        serv_sock = socket(PF_INET, SOCK_STREAM, 0);
+        if(serv_sock == -1) {
+                error_handling("socket() error");
+        }
+        setsockopt(serv_sock, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        if(reuseport && setsockopt(serv_sock, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) == -1) {
+                error_handling("setsockopt(SO_REUSEPORT) error");
+        }
+
+        memset(&serv_adr, 0, sizeof(serv_adr));
+        serv_adr.sin_family = AF_INET;
+        serv_adr.sin_addr.s_addr = htonl(INADDR_ANY);
+        serv_adr.sin_port = htons(port);
+
+        if(bind(serv_sock, (struct sockaddr*)&serv_adr, sizeof(serv_adr)) == -1) {
+                error_handling("bind() error");
+        }
+
+        if(listen(serv_sock, conf.backlog) == -1) {
+                error_handling("listen() error");
+        }
+        handoff_keep(serv_sock);
+        return serv_sock;
+}
+
+//같은 호스트 클라이언트용 UNIX 소켓 리스너 (TCP 리스너 다음에 열어야 핫 리스타트 때 순서가 맞음)
+int open_unix_listener(char *path) {
+        struct sockaddr_un adr;
+        int sock;
+
+        sock = handoff_listener();
+        if(sock != -1) {
+                handoff_keep(sock);
+                return sock;
+        }
+
+        if(strlen(path) >= sizeof(adr.sun_path)) {
+                error_handling("unix socket path too long");
+        }
+        sock = socket(AF_UNIX, SOCK_STREAM, 0);
+        if(sock == -1) {
+                error_handling("socket() error");
+        }
+        memset(&adr, 0, sizeof(adr));
+        adr.sun_family = AF_UNIX;
+        strcpy(adr.sun_path, path);
+        //이전 실행이 남긴 소켓 파일
+        unlink(path);
+        if(bind(sock, (struct sockaddr*)&adr, sizeof(adr)) == -1) {
+                error_handling("bind() error");
+        }
+        if(listen(sock, conf.backlog) == -1) {
+                error_handling("listen() error");
+        }
+        handoff_keep(sock);
+        return sock;
+}
+
+//UNIX 소켓 연결은 주소 대신 sin_family만 AF_UNIX로 표시 (IP는 0)
+void unix_peer(struct sockaddr_in *peer) {
+        memset(peer, 0, sizeof(*peer));
+        peer->sin_family = AF_UNIX;
+}
+
+//리액터(또는 스레드) i를 고정할 CPU, 목록이 없으면 -1
+//워커 프로세스끼리 같은 CPU에 몰리지 않도록 워커 번호만큼 밀어서 배정
+int reactor_cpu(int i) {
+        int base = conf.worker_id > 0 ? conf.worker_id * conf.n_reactor : 0;
+
+        if(conf.n_cpu == 0) {
+                return -1;
+        }
+        return conf.cpus[(base + i) % conf.n_cpu];
+}
+
+//저지연 모드 : 작은 READY/RESULT가 Nagle에 묶이지 않게 하고, 수신 대기 중 NIC 큐를 직접 폴링
+void set_lowlat(int fd) {
+        static int warned = 0;
+        int on = 1;
+
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+        if(conf.busy_poll_us > 0 && setsockopt(fd, SOL_SOCKET, SO_BUSY_POLL, &conf.busy_poll_us, sizeof(int)) == -1 && !warned) {
+                //sysctl net.core.busy_read보다 크게 하려면 CAP_NET_ADMIN 필요
+                warned = 1;
+                fprintf(stderr, "setsockopt(SO_BUSY_POLL) : %s\n", strerror(errno));
+        }
+}
+
+//"0,2,4" 형식의 CPU 목록
+int parse_cpus(char *str) {
+        char *tok;
+
+        conf.n_cpu = 0;
+        for(tok = strtok(str, ",") ; tok != NULL ; tok = strtok(NULL, ",")) {
+                if(conf.n_cpu >= MAX_CPUS) {
+                        return -1;
+                }
+                conf.cpus[conf.n_cpu++] = atoi(tok);
+        }
+        return conf.n_cpu > 0 ? 0 : -1;
+}
+
+//"바이트,메시지수" 형식의 송신 큐 한계
+int parse_hwm(char *str) {
+        char *comma = strchr(str, ',');
+
+        conf.hwm_bytes = atol(str);
+        if(comma != NULL) {
+                conf.hwm_msgs = atoi(comma + 1);
+        }
+        return conf.hwm_bytes > 0 && conf.hwm_msgs > 0 ? 0 : -1;
+}
+
+//"메시지수,tick(ms)" 형식의 송신 묶음 한계
+int parse_batch(char *str) {
+        char *comma = strchr(str, ',');
+
+        conf.batch = atoi(str);
+        if(comma != NULL) {
+                conf.tick_ms = atoi(comma + 1);
+        }
+        return conf.batch > 0 && conf.batch <= IOV_BATCH && conf.tick_ms >= 0 ? 0 : -1;
+}
+
+//"경로,레벨,샘플" 형식, 뒤쪽은 생략 가능
+int parse_log(char *str) {
+        char *tok;
+
+        tok = strtok(str, ",");
+        if(tok == NULL) {
+                return -1;
+        }
+        conf.log_path = tok;
+        tok = strtok(NULL, ",");
+        if(tok != NULL) {
+                conf.log_level = log_parse_level(tok);
+                tok = strtok(NULL, ",");
+        }
+        if(tok != NULL) {
+                conf.log_sample = atoi(tok);
+        }
+        return conf.log_level >= 0 && conf.log_sample > 0 ? 0 : -1;
+}
+
+//"idle(ms),timeout(ms)" 형식의 하트비트 설정, "0"이면 끔
+int parse_hb(char *str) {
+        char *comma = strchr(str, ',');
+
+        conf.hb_idle = atoi(str);
+        if(conf.hb_idle == 0) {
+                return 0;
+        }
+        conf.hb_timeout = comma != NULL ? atoi(comma + 1) : conf.hb_idle * 3;
+        return conf.hb_idle > 0 && conf.hb_timeout > conf.hb_idle ? 0 : -1;
+}
+
+//"워커수,match|least" 형식
+int parse_workers(char *str) {
+        char *comma = strchr(str, ',');
+
+        conf.n_worker = atoi(str);
+        if(comma != NULL) {
+                if(!strcmp(comma + 1, "match")) {
+                        conf.worker_policy = WP_MATCH;
+                } else if(!strcmp(comma + 1, "least")) {
+                        conf.worker_policy = WP_LEAST;
+                } else {
+                        return -1;
+                }
+        }
+        return conf.n_worker > 0 ? 0 : -1;
+}
+
+//"nodelay|spin[,busy_poll_us]" 형식
+int parse_lowlat(char *str) {
+        char *tok;
+
+        tok = strtok(str, ",");
+        if(tok != NULL && !strcmp(tok, "nodelay")) {
+                conf.lowlat = LL_NODELAY;
+        } else if(tok != NULL && !strcmp(tok, "spin")) {
+                conf.lowlat = LL_SPIN;
+        } else {
+                return -1;
+        }
+        if((tok = strtok(NULL, ",")) != NULL) {
+                conf.busy_poll_us = atoi(tok);
+        }
+        return conf.busy_poll_us >= 0 ? 0 : -1;
+}
+
+//"backlog,max_conn,rate" 형식, 뒤쪽은 생략 가능 (0이면 제한 없음)
+int parse_admit(char *str) {
+        char *tok;
+
+        tok = strtok(str, ",");
+        if(tok == NULL || (conf.backlog = atoi(tok)) < 1) {
+                return -1;
+        }
+        if((tok = strtok(NULL, ",")) != NULL) {
+                conf.max_conn = atol(tok);
+                if((tok = strtok(NULL, ",")) != NULL) {
+                        conf.accept_rate = atol(tok);
+                }
+        }
+        return conf.max_conn >= 0 && conf.accept_rate >= 0 ? 0 : -1;
+}
+
+//"all=50/100,ready=5/10,kick" 형식, 이름=초당/버킷 (버킷 생략하면 초당과 같음)
+//이름 : all, bytes, text, ready, result / 동작 : drop, kick
+int parse_limit(char *str) {
+        static char *names[RL_N] = { "all", "bytes", "text", "ready", "result" };
+        char *tok, *eq, *slash;
         int i;
-        pthread_mutex_lock(&mutx);
-        for(i = 0 ; i < clnt_cnt ; i++) {
-                write(clnt_socks[i], msg, len);
-                printf("%s\n", msg);
+
+        for(tok = strtok(str, ",") ; tok != NULL ; tok = strtok(NULL, ",")) {
+                if(!strcmp(tok, "drop")) {
+                        conf.rl_action = RL_DROP;
+                        continue;
+                }
+                if(!strcmp(tok, "kick")) {
+                        conf.rl_action = RL_KICK;
+                        continue;
+                }
+                eq = strchr(tok, '=');
+                if(eq == NULL) {
+                        return -1;
+                }
+                *eq = 0;
+                for(i = 0 ; i < RL_N && strcmp(tok, names[i]) ; i++);
+                if(i == RL_N) {
+                        return -1;
+                }
+                conf.rl[i].rate = atol(eq + 1);
+                slash = strchr(eq + 1, '/');
+                conf.rl[i].burst = slash != NULL ? atol(slash + 1) : conf.rl[i].rate;
+                //rate 0은 그 버킷을 끔 (burst는 보지 않음)
+                if(conf.rl[i].rate < 0 || (conf.rl[i].rate > 0 && conf.rl[i].burst < 1)) {
+                        return -1;
+                }
         }
-        pthread_mutex_unlock(&mutx);
+        return 0;
+}
+
+//블로킹 소켓의 수신 타임아웃, 0이면 무제한
+static void set_rcvtimeo(int fd, int ms) {
+        struct timeval tv;
+
+        tv.tv_sec = ms / 1000;
+        tv.tv_usec = (ms % 1000) * 1000;
+        setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+long now_ms(void) {
+        struct timespec ts;
+
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return ts.tv_sec * 1000L + ts.tv_nsec / 1000000;
+}
+
+void on_sigusr1(int sig) {
+        uint64_t one = 1;
+
+        dump_req = 1;
+        if(sig_wake_fd != -1) {
+                write(sig_wake_fd, &one, sizeof(one));
+        }
+}
+
+//논블로킹 소켓에도 len 바이트를 모두 쓸 때까지 대기
+int write_full(int fd, char *buf, int len) {
+        int n, done = 0;
+        struct pollfd pfd;
+
+        while(done < len) {
+                n = write(fd, buf + done, len - done);
+                if(n > 0) {
+                        done += n;
+                } else if(n == -1 && errno == EAGAIN) {
+                        pfd.fd = fd;
+                        pfd.events = POLLOUT;
+                        poll(&pfd, 1, -1);
+                } else if(n == -1 && errno == EINTR) {
+                        continue;
+                } else {
+                        return -1;
+                }
+        }
+        return done;
+}
+
+void usage(char *name) {
+        printf("Usage : %s [-m thread|epoll|reuseport|uring] [-t reactors] [-a cpu,cpu,...]\n\t[-w bytes,msgs] [-p drop|coalesce|disconnect] [-c pool] [-b msgs,tick_ms]\n\t[-l path,level,sample] [-k idle_ms,timeout_ms] [-r ctl_path] [-P workers,match|least]\n\t[-q name=rate/burst,...,drop|kick] [-A backlog,max_conn,rate]\n\t[-L nodelay|spin[,busy_poll_us]] [-u unix_path] [-B slots] [-M metrics_port] [-C admin_path] <port>\n", name);
+        exit(1);
 }
 
 void error_handling(char *buf) {
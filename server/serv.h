@@ -0,0 +1,105 @@
+#ifndef SERV_H
+#define SERV_H
+
+#include <pthread.h>
+
+#define MAX_CPUS 64
+
+//서버 동작 모드
+#define MODE_THREAD 0
+#define MODE_EPOLL 1
+#define MODE_REUSEPORT 2
+#define MODE_URING 3
+
+//송신 큐가 한계를 넘었을 때 정책
+#define BP_DROP 0               //오래된 일반 메시지부터 버림
+#define BP_COALESCE 1           //같은 플레이어의 이전 상태 메시지를 새 것으로 교체
+#define BP_DISCONNECT 2         //연결 종료
+
+//수신 속도 제한 버킷 (-q)
+#define RL_ALL 0                //연결이 보내는 모든 메시지
+#define RL_BYTES 1              //연결이 보내는 모든 바이트
+#define RL_TEXT 2               //타입별 버킷 = RL_TEXT + 프레임 타입
+#define RL_READY 3
+#define RL_RESULT 4
+#define RL_N 5
+
+//속도 제한을 넘었을 때
+#define RL_DROP 0               //그 메시지만 버림
+#define RL_KICK 1               //연결 종료
+
+struct rl_conf {
+        long rate;              //초당 토큰, 0이면 제한 없음
+        long burst;             //버킷 크기
+};
+
+//저지연 모드 (-L)
+#define LL_OFF 0
+#define LL_NODELAY 1            //TCP_NODELAY, SO_BUSY_POLL, 스레드 CPU 고정
+#define LL_SPIN 2               //위 설정 + 리액터가 잠들지 않고 계속 폴링
+
+#define ACCEPT_BATCH 16         //리액터가 루프 1회에 받는 최대 연결 수
+#define ADMIT_RETRY_MS 1000     //연결 수 한계로 거절할 때 알려주는 재시도 시간
+
+//서버 설정 (main에서 옵션으로 채움)
+struct serv_conf {
+        int port;
+        int mode;
+        int n_reactor;
+        int n_cpu;              //0이면 CPU 고정 안 함
+        int cpus[MAX_CPUS];     //리액터 i -> cpus[i % n_cpu]
+        long hwm_bytes;         //연결당 송신 큐 한계 (바이트)
+        int hwm_msgs;           //연결당 송신 큐 한계 (메시지 수)
+        int bp_policy;
+        int pool_size;          //미리 할당할 연결 컨텍스트 수
+        int batch;              //송신 시스템 콜 1회에 묶는 최대 메시지 수
+        int tick_ms;            //송신 flush 주기, 0이면 이벤트 루프 1회마다
+        char *log_path;         //"-"면 표준 출력
+        int log_level;
+        int log_sample;         //메시지 중계 로그는 log_sample개 중 1개만
+        int hb_idle;            //이 시간(ms) 동안 받은 게 없으면 PING, 0이면 하트비트 안 함
+        int hb_timeout;         //이 시간(ms) 동안 받은 게 없거나 송신이 막혀 있으면 연결 종료
+        char *restart_path;     //핫 리스타트 제어 소켓 경로, NULL이면 사용 안 함
+        int n_worker;           //워커 프로세스 수, 0이면 단일 프로세스
+        int worker_policy;      //워커 선택 방식 (worker.h)
+        int chan;               //워커 프로세스 : accept 프로세스와의 채널, 아니면 -1
+        int worker_id;
+        struct rl_conf rl[RL_N];
+        int rl_action;
+        int backlog;            //listen() 대기열 길이
+        long max_conn;          //동시 연결 한계, 0이면 제한 없음
+        long accept_rate;       //초당 새 연결 한계, 0이면 제한 없음
+        int lowlat;
+        int busy_poll_us;       //SO_BUSY_POLL 값, 0이면 설정 안 함
+        char *unix_path;        //같은 호스트 클라이언트용 UNIX 소켓 경로, NULL이면 사용 안 함
+        int bring_slots;        //브로드캐스트 링 슬롯 수 (2의 거듭제곱), 0이면 연결마다 큐에 넣음
+        int metrics_port;       //메트릭 HTTP 포트 (127.0.0.1), 0이면 사용 안 함
+        char *admin_path;       //관리 콘솔 UNIX 소켓 경로, NULL이면 사용 안 함
+};
+
+struct sockaddr_in;
+struct conn;
+
+int open_listener(int port, int reuseport);
+int open_unix_listener(char *path);
+void unix_peer(struct sockaddr_in *peer);
+void send_msg(struct conn *from, int type, char *msg, int len);
+int write_full(int fd, char *buf, int len);
+int reactor_cpu(int i);
+int parse_limit(char *str);
+void set_lowlat(int fd);
+long now_ms(void);
+void error_handling(char *buf);
+
+//reactor.c
+void run_epoll(void);
+int set_nonblock(int fd);
+
+//uring.c
+int run_uring(void);
+
+extern struct serv_conf conf;
+extern volatile int dump_req;
+extern int sig_wake_fd;
+
+#endif
@@ -0,0 +1,109 @@
+#include <stddef.h>
+#include "timer.h"
+
+__thread long tick_now;
+
+static void slot_insert(struct timer *head, struct timer *t) {
+        t->next = head->next;
+        t->prev = head;
+        head->next->prev = t;
+        head->next = t;
+}
+
+void wheel_init(struct wheel *w, long now) {
+        int i;
+
+        for(i = 0 ; i < WHEEL_SLOTS ; i++) {
+                w->slots[i].next = w->slots[i].prev = &w->slots[i];
+        }
+        w->tick = now / WHEEL_TICK_MS;
+        w->now = now;
+        w->count = 0;
+        tick_now = now;
+}
+
+//ms 뒤에 t->fn 호출, 이미 걸려 있으면 옮김
+void timer_add(struct wheel *w, struct timer *t, long ms) {
+        long expire = (w->now + ms + WHEEL_TICK_MS - 1) / WHEEL_TICK_MS;
+
+        if(t->next != NULL) {
+                timer_del(w, t);
+        }
+        if(expire < w->tick) {
+                expire = w->tick;
+        }
+        t->expire = expire;
+        slot_insert(&w->slots[expire & (WHEEL_SLOTS - 1)], t);
+        w->count++;
+}
+
+void timer_del(struct wheel *w, struct timer *t) {
+        if(t->next == NULL) {
+                return;
+        }
+        t->prev->next = t->next;
+        t->next->prev = t->prev;
+        t->next = t->prev = NULL;
+        w->count--;
+}
+
+//슬롯 하나에서 target tick까지 만료된 타이머 실행
+//콜백이 다시 timer_add해도 되도록 슬롯을 떼어낸 뒤 처리
+static void run_slot(struct wheel *w, struct timer *head, long target) {
+        struct timer list, *t;
+
+        if(head->next == head) {
+                return;
+        }
+        list.next = head->next;
+        list.prev = head->prev;
+        list.next->prev = &list;
+        list.prev->next = &list;
+        head->next = head->prev = head;
+
+        while(list.next != &list) {
+                t = list.next;
+                t->prev->next = t->next;
+                t->next->prev = t->prev;
+                if(t->expire > target) {
+                        slot_insert(head, t);
+                        continue;
+                }
+                t->next = t->prev = NULL;
+                w->count--;
+                t->fn(t);
+        }
+}
+
+//now까지 지난 tick의 슬롯을 처리 (오래 멈춰 있었으면 모든 슬롯을 한 번씩)
+void wheel_run(struct wheel *w, long now) {
+        long target = now / WHEEL_TICK_MS;
+        int n = 0;
+
+        w->now = now;
+        tick_now = now;
+        if(w->count == 0) {
+                w->tick = target + 1;
+                return;
+        }
+        //콜백에서 새로 건 타이머는 다음 tick 이후 슬롯에 들어가도록 tick을 먼저 올림
+        while(w->tick <= target && n < WHEEL_SLOTS) {
+                w->tick++;
+                run_slot(w, &w->slots[(w->tick - 1) & (WHEEL_SLOTS - 1)], target);
+                n++;
+        }
+        if(w->tick <= target) {
+                w->tick = target + 1;
+        }
+}
+
+//다음 tick까지 남은 ms, 타이머가 없으면 -1
+long wheel_timeout(struct wheel *w, long now) {
+        long wait;
+
+        if(w->count == 0) {
+                return -1;
+        }
+        wait = w->tick * WHEEL_TICK_MS - now;
+        return wait > 0 ? wait : 0;
+}
@@ -0,0 +1,33 @@
+#ifndef TIMER_H
+#define TIMER_H
+
+//해시 타이밍 휠 (리액터마다 1개, 소유 스레드만 접근)
+//만료 tick을 슬롯 수로 나눈 나머지 슬롯에 넣으므로 추가/삭제가 O(1)
+//한 바퀴보다 먼 타이머는 슬롯에 남아 있다가 만료 tick이 되면 실행됨
+
+#define WHEEL_SLOTS 512         //2의 거듭제곱
+#define WHEEL_TICK_MS 100
+
+struct timer {
+        struct timer *next, *prev;
+        long expire;            //만료 tick
+        void (*fn)(struct timer *t);
+};
+
+struct wheel {
+        struct timer slots[WHEEL_SLOTS];        //슬롯별 원형 리스트 헤드
+        long tick;              //다음에 처리할 tick
+        long now;               //마지막 wheel_run 시각 (ms)
+        int count;
+};
+
+//이 스레드의 리액터가 마지막으로 wheel_run을 호출한 시각 (ms)
+extern __thread long tick_now;
+
+void wheel_init(struct wheel *w, long now);
+void wheel_run(struct wheel *w, long now);
+long wheel_timeout(struct wheel *w, long now);
+void timer_add(struct wheel *w, struct timer *t, long ms);
+void timer_del(struct wheel *w, struct timer *t);
+
+#endif
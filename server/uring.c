@@ -0,0 +1,668 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <pthread.h>
+#include <sched.h>
+#include "serv.h"
+#include "conn.h"
+#include "log.h"
+#include "handoff.h"
+#include "worker.h"
+
+//io_uring 백엔드 (liburing 없이 시스템 콜 직접 사용)
+//multishot accept, provided buffer recv, 루프 1회당 한 번에 submit
+
+#define UR_ENTRIES 1024
+#define UR_BUFS 256             //provided buffer 개수 (2의 거듭제곱)
+#define UR_BUF_SIZE 2048        //provided buffer 크기, 프레임은 여러 버퍼에 걸쳐도 됨
+#define UR_BGID 0
+#define UR_ACCEPT_BACKOFF_MS 100        //fd가 모자라서 accept가 실패하면 이만큼 쉬었다가 다시 걸음
+
+//user_data 상위 8비트 = 요청 종류
+#define UD_ACCEPT 1ULL
+#define UD_RECV 2ULL
+#define UD_SEND 3ULL
+#define UD_WAKE 4ULL
+#define UD_TICK 5ULL
+#define UD_WHEEL 6ULL
+#define UD_CANCEL 7ULL
+#define UD_BACKOFF 8ULL
+#define UD(type, val) (((type) << 56) | (uint64_t)(val))
+#define UD_TYPE(ud) ((ud) >> 56)
+#define UD_VAL(ud) ((ud) & ((1ULL << 56) - 1))
+
+struct uring {
+        int id;
+        int cpu;
+        int ring_fd;
+        int listen_sock;
+        int unix_sock;                  //UNIX 소켓 리스너 (0번 링만), 없으면 -1
+        pthread_t t_id;
+
+        char *sq_ptr;                   //SQ/CQ 링 매핑 (해제할 때 씀)
+        size_t sq_sz;
+        unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+        unsigned sq_entries;
+        struct io_uring_sqe *sqes;
+        unsigned sq_local;              //아직 커널에 알리지 않은 tail
+        unsigned to_submit;
+
+        unsigned *cq_head, *cq_tail, *cq_mask;
+        struct io_uring_cqe *cqes;
+
+        struct io_uring_buf_ring *br;
+        char *bufs;
+        unsigned short br_tail;
+
+        int ms_accept;                  //multishot 미지원 커널이면 0으로 떨어짐
+        int accept_wait;                //EMFILE/ENFILE로 멈춘 accept (1 << local)
+        struct __kernel_timespec backoff_ts;
+        int ms_recv;
+
+        struct flushq fq;               //송신 큐에 메시지가 생긴 연결 목록
+        uint64_t wake_cnt;              //eventfd read 버퍼
+        long next_flush;                //다음 flush 시각 (ms, conf.tick_ms > 0일 때)
+        int tick_armed;                 //tick 타임아웃이 걸려 있는지
+        struct __kernel_timespec tick_ts;
+        struct wheel wheel;             //하트비트 타이머
+        int wheel_armed;
+        struct __kernel_timespec wheel_ts;
+        int ho_phase;                   //처리한 핫 리스타트 단계
+        struct chan_msg chan;           //워커 프로세스 : 채널 recvmsg 버퍼
+};
+
+static struct uring *rings;
+static int ring_cnt;
+static __thread struct uring *cur_ring;
+
+static int ring_setup(struct uring *r);
+static void ring_free(struct uring *r);
+static void *uring_loop(void *arg);
+static void arm_accept(struct uring *r, int local);
+static void arm_recv(struct uring *r, struct conn *c);
+static void arm_wake(struct uring *r);
+static void arm_timeout(struct uring *r, struct __kernel_timespec *ts, long wait, uint64_t ud);
+static void on_accept(struct uring *r, struct io_uring_cqe *cqe);
+static void on_recv(struct uring *r, struct io_uring_cqe *cqe);
+static void on_send(struct uring *r, struct io_uring_cqe *cqe);
+static void uring_flush(struct conn *c);
+static void uring_handoff(struct uring *r);
+
+static int sys_setup(unsigned entries, struct io_uring_params *p) {
+        return syscall(__NR_io_uring_setup, entries, p);
+}
+
+static int sys_enter(int fd, unsigned to_submit, unsigned min_complete, unsigned flags) {
+        return syscall(__NR_io_uring_enter, fd, to_submit, min_complete, flags, NULL, 0);
+}
+
+static int sys_register(int fd, unsigned op, void *arg, unsigned nr) {
+        return syscall(__NR_io_uring_register, fd, op, arg, nr);
+}
+
+//io_uring 모드 실행, 커널이 지원하지 않으면 -1 반환 (호출한 쪽에서 epoll로 대체)
+int run_uring(void) {
+        struct uring *r;
+        struct conn *c;
+        int i;
+
+        ring_cnt = conf.n_reactor;
+        rings = calloc(ring_cnt, sizeof(struct uring));
+        if(rings == NULL) {
+                error_handling("calloc() error");
+        }
+
+        for(i = 0 ; i < ring_cnt ; i++) {
+                rings[i].id = i;
+                rings[i].cpu = reactor_cpu(i);
+                if(ring_setup(&rings[i]) == -1) {
+                        fprintf(stderr, "io_uring unavailable (%s), falling back to epoll\n", strerror(errno));
+                        while(i-- > 0) {
+                                ring_free(&rings[i]);
+                        }
+                        free(rings);
+                        return -1;
+                }
+        }
+
+        //링마다 리스너 1개, 링이 여러 개면 SO_REUSEPORT로 분산
+        for(i = 0 ; i < ring_cnt ; i++) {
+                r = &rings[i];
+                r->listen_sock = conf.chan != -1 ? conf.chan : open_listener(conf.port, ring_cnt > 1);
+                if(r->cpu != -1) {
+                        setsockopt(r->listen_sock, SOL_SOCKET, SO_INCOMING_CPU, &r->cpu, sizeof(r->cpu));
+                }
+                flushq_init(&r->fq);
+                wheel_init(&r->wheel, now_ms());
+                handoff_add_wake(r->fq.efd);
+                r->unix_sock = -1;
+                arm_accept(r, 0);
+                arm_wake(r);
+        }
+
+        //UNIX 소켓은 0번 링이 받음, 공유 메모리 전환은 epoll 모드에서만 지원
+        if(conf.unix_path != NULL && conf.chan == -1) {
+                rings[0].unix_sock = open_unix_listener(conf.unix_path);
+                arm_accept(&rings[0], 1);
+        }
+
+        //핫 리스타트로 넘겨받은 연결은 링마다 돌아가며 배정
+        for(i = 0 ; (c = handoff_take()) != NULL ; i++) {
+                r = &rings[i % ring_cnt];
+                c->fq = &r->fq;
+                //새 프로세스에서는 ID가 바뀜
+                conn_hello(c);
+                arm_recv(r, c);
+                conn_watch(c, &r->wheel);
+        }
+        handoff_serve();
+
+        for(i = 1 ; i < ring_cnt ; i++) {
+                pthread_create(&rings[i].t_id, NULL, uring_loop, &rings[i]);
+        }
+        LOG(LOG_INFO, EV_START, MODE_URING, ring_cnt, 0);
+
+        rings[0].t_id = pthread_self();
+        sig_wake_fd = rings[0].fq.efd;
+        uring_loop(&rings[0]);
+        return 0;
+}
+
+static int ring_setup(struct uring *r) {
+        struct io_uring_params p;
+        struct io_uring_buf_reg reg;
+        size_t sq_sz, cq_sz, br_sz;
+        char *sq_ptr, *cq_ptr;
+        int i;
+
+        memset(&p, 0, sizeof(p));
+        p.flags = IORING_SETUP_CQSIZE;
+        p.cq_entries = UR_ENTRIES * 4;
+        r->ring_fd = sys_setup(UR_ENTRIES, &p);
+        if(r->ring_fd == -1) {
+                return -1;
+        }
+        if(!(p.features & IORING_FEAT_SINGLE_MMAP) || !(p.features & IORING_FEAT_NODROP)) {
+                close(r->ring_fd);
+                errno = ENOTSUP;
+                return -1;
+        }
+
+        sq_sz = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+        cq_sz = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+        if(cq_sz > sq_sz) {
+                sq_sz = cq_sz;
+        }
+        sq_ptr = mmap(NULL, sq_sz, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->ring_fd, IORING_OFF_SQ_RING);
+        if(sq_ptr == MAP_FAILED) {
+                close(r->ring_fd);
+                return -1;
+        }
+        r->sq_ptr = sq_ptr;
+        r->sq_sz = sq_sz;
+        cq_ptr = sq_ptr;
+
+        r->sq_head = (unsigned *)(sq_ptr + p.sq_off.head);
+        r->sq_tail = (unsigned *)(sq_ptr + p.sq_off.tail);
+        r->sq_mask = (unsigned *)(sq_ptr + p.sq_off.ring_mask);
+        r->sq_array = (unsigned *)(sq_ptr + p.sq_off.array);
+        r->sq_entries = p.sq_entries;
+        r->sq_local = *r->sq_tail;
+
+        r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->ring_fd, IORING_OFF_SQES);
+        if(r->sqes == MAP_FAILED) {
+                r->sqes = NULL;
+                ring_free(r);
+                return -1;
+        }
+
+        r->cq_head = (unsigned *)(cq_ptr + p.cq_off.head);
+        r->cq_tail = (unsigned *)(cq_ptr + p.cq_off.tail);
+        r->cq_mask = (unsigned *)(cq_ptr + p.cq_off.ring_mask);
+        r->cqes = (struct io_uring_cqe *)(cq_ptr + p.cq_off.cqes);
+
+        //provided buffer ring 등록 (5.19 이상)
+        br_sz = UR_BUFS * sizeof(struct io_uring_buf);
+        r->br = mmap(NULL, br_sz, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        r->bufs = malloc(UR_BUFS * UR_BUF_SIZE);
+        if(r->br == MAP_FAILED || r->bufs == NULL) {
+                if(r->br == MAP_FAILED) {
+                        r->br = NULL;
+                }
+                ring_free(r);
+                return -1;
+        }
+        memset(&reg, 0, sizeof(reg));
+        reg.ring_addr = (unsigned long)r->br;
+        reg.ring_entries = UR_BUFS;
+        reg.bgid = UR_BGID;
+        if(sys_register(r->ring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) == -1) {
+                ring_free(r);
+                return -1;
+        }
+        for(i = 0 ; i < UR_BUFS ; i++) {
+                r->br->bufs[i].addr = (unsigned long)(r->bufs + i * UR_BUF_SIZE);
+                r->br->bufs[i].len = UR_BUF_SIZE;
+                r->br->bufs[i].bid = i;
+        }
+        r->br_tail = UR_BUFS;
+        __atomic_store_n(&r->br->tail, r->br_tail, __ATOMIC_RELEASE);
+
+        r->ms_accept = 1;
+        r->ms_recv = 1;
+        return 0;
+}
+
+//ring_setup 실패나 epoll로 대체할 때 : 매핑과 버퍼를 풀고 링을 닫음 (errno는 보존)
+static void ring_free(struct uring *r) {
+        int err = errno;
+
+        if(r->br != NULL) {
+                munmap(r->br, UR_BUFS * sizeof(struct io_uring_buf));
+                r->br = NULL;
+        }
+        free(r->bufs);
+        r->bufs = NULL;
+        if(r->sqes != NULL) {
+                munmap(r->sqes, r->sq_entries * sizeof(struct io_uring_sqe));
+                r->sqes = NULL;
+        }
+        if(r->sq_ptr != NULL) {
+                munmap(r->sq_ptr, r->sq_sz);
+                r->sq_ptr = NULL;
+        }
+        close(r->ring_fd);
+        errno = err;
+}
+
+//SQ에 쌓인 요청을 커널에 제출
+static void ring_submit(struct uring *r, unsigned min_complete) {
+        unsigned flags = min_complete ? IORING_ENTER_GETEVENTS : 0;
+        int ret;
+
+        __atomic_store_n(r->sq_tail, r->sq_local, __ATOMIC_RELEASE);
+        while(1) {
+                ret = sys_enter(r->ring_fd, r->to_submit, min_complete, flags);
+                if(ret >= 0) {
+                        r->to_submit -= (unsigned)ret < r->to_submit ? (unsigned)ret : r->to_submit;
+                        return;
+                }
+                if(errno == EINTR) {
+                        if(min_complete) {
+                                return;
+                        }
+                        continue;
+                }
+                if(errno == EAGAIN || errno == EBUSY) {
+                        //CQ가 가득 참, 완료를 먼저 처리해야 함
+                        return;
+                }
+                error_handling("io_uring_enter() error");
+        }
+}
+
+static struct io_uring_sqe *get_sqe(struct uring *r) {
+        struct io_uring_sqe *sqe;
+        unsigned head;
+
+        head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        while(r->sq_local - head >= r->sq_entries) {
+                ring_submit(r, 0);
+                head = __atomic_load_n(r->sq_head, __ATOMIC_ACQUIRE);
+        }
+        sqe = &r->sqes[r->sq_local & *r->sq_mask];
+        r->sq_array[r->sq_local & *r->sq_mask] = r->sq_local & *r->sq_mask;
+        r->sq_local++;
+        r->to_submit++;
+        memset(sqe, 0, sizeof(*sqe));
+        return sqe;
+}
+
+//local이면 UNIX 소켓 리스너
+static void arm_accept(struct uring *r, int local) {
+        struct io_uring_sqe *sqe = get_sqe(r);
+
+        //워커 프로세스는 채널에서 fd를 받음 (1회성 recvmsg)
+        if(conf.chan != -1) {
+                chan_prep(&r->chan);
+                sqe->opcode = IORING_OP_RECVMSG;
+                sqe->fd = r->listen_sock;
+                sqe->addr = (unsigned long)&r->chan.mh;
+                sqe->len = 1;
+                sqe->msg_flags = MSG_CMSG_CLOEXEC;
+                sqe->user_data = UD(UD_ACCEPT, 0);
+                return;
+        }
+        sqe->opcode = IORING_OP_ACCEPT;
+        sqe->fd = local ? r->unix_sock : r->listen_sock;
+        sqe->accept_flags = SOCK_CLOEXEC;
+        sqe->ioprio = r->ms_accept ? IORING_ACCEPT_MULTISHOT : 0;
+        sqe->user_data = UD(UD_ACCEPT, local);
+}
+
+static void arm_recv(struct uring *r, struct conn *c) {
+        struct io_uring_sqe *sqe = get_sqe(r);
+
+        sqe->opcode = IORING_OP_RECV;
+        sqe->fd = c->fd;
+        sqe->flags = IOSQE_BUFFER_SELECT;
+        sqe->buf_group = UR_BGID;
+        sqe->ioprio = r->ms_recv ? IORING_RECV_MULTISHOT : 0;
+        sqe->user_data = UD(UD_RECV, (uintptr_t)c);
+}
+
+//다른 스레드가 flushq에 연결을 넣으면 eventfd로 깨어남
+static void arm_wake(struct uring *r) {
+        struct io_uring_sqe *sqe = get_sqe(r);
+
+        sqe->opcode = IORING_OP_READ;
+        sqe->fd = r->fq.efd;
+        sqe->addr = (unsigned long)&r->wake_cnt;
+        sqe->len = sizeof(r->wake_cnt);
+        sqe->user_data = UD(UD_WAKE, 0);
+}
+
+//wait ms 뒤에 깨어나도록 타임아웃 등록 (tick flush, 휠 tick)
+static void arm_timeout(struct uring *r, struct __kernel_timespec *ts, long wait, uint64_t ud) {
+        struct io_uring_sqe *sqe;
+
+        ts->tv_sec = wait / 1000;
+        ts->tv_nsec = (wait % 1000) * 1000000;
+        sqe = get_sqe(r);
+        sqe->opcode = IORING_OP_TIMEOUT;
+        sqe->addr = (unsigned long)ts;
+        sqe->len = 1;
+        sqe->user_data = UD(ud, 0);
+}
+
+//사용한 provided buffer를 링에 반환
+static void recycle_buf(struct uring *r, unsigned short bid) {
+        struct io_uring_buf *b = &r->br->bufs[r->br_tail & (UR_BUFS - 1)];
+
+        b->addr = (unsigned long)(r->bufs + bid * UR_BUF_SIZE);
+        b->len = UR_BUF_SIZE;
+        b->bid = bid;
+        r->br_tail++;
+        __atomic_store_n(&r->br->tail, r->br_tail, __ATOMIC_RELEASE);
+}
+
+static void *uring_loop(void *arg) {
+        struct uring *r = (struct uring *)arg;
+        struct io_uring_cqe *cqe;
+        unsigned head, tail;
+        cpu_set_t set;
+        uint64_t one = 1;
+        long wait;
+
+        //소유 스레드는 루프 안에서 정함, 그 전에 다른 스레드가 깨우지 않고 넣은 연결은 첫 루프에서 flush
+        __atomic_store_n(&r->fq.owner, pthread_self(), __ATOMIC_RELEASE);
+        write(r->fq.efd, &one, sizeof(one));
+        cur_ring = r;
+        if(r->cpu != -1) {
+                CPU_ZERO(&set);
+                CPU_SET(r->cpu, &set);
+                if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+                        fprintf(stderr, "ring %d : cannot pin to cpu %d\n", r->id, r->cpu);
+                }
+        }
+
+        while(1) {
+                //이번 루프에서 쌓인 SQE를 한 번에 제출하고 완료 1개 이상 대기 (spin 모드는 기다리지 않음)
+                ring_submit(r, conf.lowlat == LL_SPIN ? 0 : 1);
+                wheel_run(&r->wheel, now_ms());
+
+                head = *r->cq_head;
+                tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+                while(head != tail) {
+                        cqe = &r->cqes[head & *r->cq_mask];
+                        switch(UD_TYPE(cqe->user_data)) {
+                        case UD_ACCEPT:
+                                on_accept(r, cqe);
+                                break;
+                        case UD_RECV:
+                                on_recv(r, cqe);
+                                break;
+                        case UD_SEND:
+                                on_send(r, cqe);
+                                break;
+                        case UD_WAKE:
+                                arm_wake(r);
+                                break;
+                        case UD_TICK:
+                                r->tick_armed = 0;
+                                break;
+                        case UD_WHEEL:
+                                r->wheel_armed = 0;
+                                break;
+                        case UD_BACKOFF:
+                                //쉬는 동안 fd가 풀렸기를 기대하고 다시 걸음 (핫 리스타트 중이면 걸지 않음)
+                                if(handoff_phase == HO_NONE) {
+                                        if(r->accept_wait & 1) {
+                                                arm_accept(r, 0);
+                                        }
+                                        if(r->accept_wait & 2) {
+                                                arm_accept(r, 1);
+                                        }
+                                }
+                                r->accept_wait = 0;
+                                break;
+                        }
+                        head++;
+                        //긴 배치 중에도 커널이 CQ를 계속 채울 수 있도록 바로 반영
+                        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+                        if(head == tail) {
+                                tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+                        }
+                }
+
+                //tick 동안 (tick이 0이면 이번 루프 동안) 메시지가 쌓인 연결의 send를 SQ에 추가
+                //다음 enter에서 한 번에 제출
+                if(conf.tick_ms == 0 || now_ms() >= r->next_flush) {
+                        flushq_drain(&r->fq, uring_flush);
+                        r->next_flush = now_ms() + conf.tick_ms;
+                } else if(!r->tick_armed && __atomic_load_n(&r->fq.head, __ATOMIC_RELAXED) != NULL) {
+                        //flush를 기다리는 연결이 있으면 다음 tick에 깨어나도록
+                        arm_timeout(r, &r->tick_ts, r->next_flush - now_ms(), UD_TICK);
+                        r->tick_armed = 1;
+                }
+                //타이머가 있으면 휠의 다음 tick에 깨어나도록
+                if(!r->wheel_armed && (wait = wheel_timeout(&r->wheel, now_ms())) >= 0) {
+                        arm_timeout(r, &r->wheel_ts, wait > 0 ? wait : 1, UD_WHEEL);
+                        r->wheel_armed = 1;
+                }
+
+                if(r->ho_phase != handoff_phase) {
+                        r->ho_phase = handoff_phase;
+                        uring_handoff(r);
+                }
+
+                if(dump_req && __atomic_exchange_n(&dump_req, 0, __ATOMIC_RELAXED)) {
+                        bp_dump();
+                }
+        }
+        return NULL;
+}
+
+static void on_accept(struct uring *r, struct io_uring_cqe *cqe) {
+        struct sockaddr_in clnt_adr;
+        socklen_t clnt_adr_sz = sizeof(clnt_adr);
+        int clnt_sock = cqe->res, reason, local = UD_VAL(cqe->user_data);
+        struct conn *c;
+        long retry;
+
+        if(conf.chan != -1) {
+                //채널이 닫혔으면 (accept 프로세스 종료) 더 받지 않음
+                if(clnt_sock == 0) {
+                        return;
+                }
+                clnt_sock = clnt_sock > 0 ? chan_take(&r->chan, clnt_sock) : -1;
+        }
+        if(!(cqe->flags & IORING_CQE_F_MORE)) {
+                if(handoff_phase != HO_NONE) {
+                        //핫 리스타트로 취소됨, 다시 걸지 않고 리슨 소켓을 닫음
+                        if(local) {
+                                close(r->unix_sock);
+                                r->unix_sock = -1;
+                        } else {
+                                close(r->listen_sock);
+                                r->listen_sock = -1;
+                        }
+                } else {
+                        if(clnt_sock == -EINVAL && r->ms_accept) {
+                                //multishot accept 미지원 (5.19 미만), 1회성 accept로 전환
+                                r->ms_accept = 0;
+                        }
+                        if(cqe->res == -EMFILE || cqe->res == -ENFILE) {
+                                //바로 다시 걸면 같은 에러로 계속 돎, 잠깐 쉬었다가 UD_BACKOFF에서 다시 걸음
+                                if(r->accept_wait == 0) {
+                                        arm_timeout(r, &r->backoff_ts, UR_ACCEPT_BACKOFF_MS, UD_BACKOFF);
+                                }
+                                r->accept_wait |= 1 << local;
+                        } else {
+                                arm_accept(r, local);
+                        }
+                }
+        }
+        if(clnt_sock < 0) {
+                return;
+        }
+
+        if(conf.chan != -1) {
+                clnt_adr = r->chan.peer;
+        } else {
+                if(local) {
+                        unix_peer(&clnt_adr);
+                } else {
+                        getpeername(clnt_sock, (struct sockaddr*)&clnt_adr, &clnt_adr_sz);
+                }
+                //한계를 넘으면 바로 BUSY를 보내고 닫음
+                if((retry = conn_admit(conn_count(), &reason)) > 0) {
+                        conn_reject(clnt_sock, &clnt_adr, reason, retry);
+                        return;
+                }
+        }
+        c = conn_new(clnt_sock, &r->fq, &clnt_adr);
+        if(c == NULL) {
+                close(clnt_sock);
+                return;
+        }
+        conn_hello(c);
+
+        arm_recv(r, c);
+        conn_watch(c, &r->wheel);
+        LOG(LOG_INFO, EV_CONNECT, c->id, clnt_adr.sin_addr.s_addr, r->id);
+}
+
+static void on_recv(struct uring *r, struct io_uring_cqe *cqe) {
+        struct conn *c = (struct conn *)(uintptr_t)UD_VAL(cqe->user_data);
+        unsigned short bid;
+
+        if(cqe->flags & IORING_CQE_F_BUFFER) {
+                bid = cqe->flags >> IORING_CQE_BUFFER_SHIFT;
+                //잘못된 프레임이면 recv를 끝내서 아래에서 닫히게 함
+                if(cqe->res > 0 && !c->closed && conn_feed(c, r->bufs + bid * UR_BUF_SIZE, cqe->res) == -1) {
+                        shutdown(c->fd, SHUT_RDWR);
+                }
+                //recv가 계속 걸려 있어서 공유 메모리로 옮길 수 없으므로 거절
+                if(c->shm_req) {
+                        conn_shm(c, 0);
+                }
+                recycle_buf(r, bid);
+        }
+
+        if(cqe->flags & IORING_CQE_F_MORE) {
+                return;
+        }
+        //multishot 종료 : 버퍼 부족이면 다시 걸고, EOF나 에러면 연결 종료
+        if(cqe->res > 0 || cqe->res == -ENOBUFS) {
+                arm_recv(r, c);
+        } else if(cqe->res == -EINVAL && r->ms_recv) {
+                r->ms_recv = 0;
+                arm_recv(r, c);
+        } else {
+                conn_close(c);
+        }
+}
+
+//연결당 sendmsg는 한 번에 1개만 진행해서 순서 보장
+static void uring_flush(struct conn *c) {
+        struct io_uring_sqe *sqe;
+        int n, more;
+
+        if(c->closed) {
+                return;
+        }
+        //송신 큐 초과로 종료 : recv가 끝나면서 on_recv에서 닫힘
+        if(c->kill) {
+                shutdown(c->fd, SHUT_RDWR);
+                return;
+        }
+        if(c->sending) {
+                return;
+        }
+        n = outq_fill(c, c->iov, conf.batch, &more);
+        if(n == 0) {
+                return;
+        }
+        memset(&c->mh, 0, sizeof(c->mh));
+        c->mh.msg_iov = c->iov;
+        c->mh.msg_iovlen = n;
+
+        sqe = get_sqe(cur_ring);
+        sqe->opcode = IORING_OP_SENDMSG;
+        sqe->fd = c->fd;
+        sqe->addr = (unsigned long)&c->mh;
+        sqe->msg_flags = more ? MSG_MORE | MSG_NOSIGNAL : MSG_NOSIGNAL;
+        sqe->user_data = UD(UD_SEND, (uintptr_t)c);
+        c->sending = 1;
+        conn_hold(c);
+}
+
+static void on_send(struct uring *r, struct io_uring_cqe *cqe) {
+        struct conn *c = (struct conn *)(uintptr_t)UD_VAL(cqe->user_data);
+
+        c->sending = 0;
+        if(cqe->res > 0 && !c->closed) {
+                outq_consume(c, cqe->res);
+                uring_flush(c);
+        } else if(!c->closed) {
+                //전송 중 표시를 풀어야 병합/버리기와 링 넘김이 다시 가능
+                outq_consume(c, 0);
+                if(cqe->res == -EINTR || cqe->res == -EAGAIN) {
+                        uring_flush(c);
+                } else {
+                        //연결 종료는 recv 쪽에서 처리 (recv가 끝나면서 on_recv에서 닫힘)
+                        shutdown(c->fd, SHUT_RDWR);
+                }
+        }
+        conn_put(c);
+}
+
+//핫 리스타트 : 진행 중인 accept를 취소 (리슨 소켓은 취소 완료 후 on_accept에서 닫음)
+//연결은 진행 중인 recv/sendmsg가 있어서 넘기지 않고 끝날 때까지 계속 처리
+static void uring_handoff(struct uring *r) {
+        struct io_uring_sqe *sqe;
+
+        if(r->ho_phase == HO_STOP && r->listen_sock != -1) {
+                sqe = get_sqe(r);
+                sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                sqe->addr = UD(UD_ACCEPT, 0);
+                sqe->user_data = UD(UD_CANCEL, 0);
+                if(r->unix_sock != -1) {
+                        sqe = get_sqe(r);
+                        sqe->opcode = IORING_OP_ASYNC_CANCEL;
+                        sqe->addr = UD(UD_ACCEPT, 1);
+                        sqe->user_data = UD(UD_CANCEL, 0);
+                }
+        }
+        handoff_done();
+}
@@ -0,0 +1,348 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <time.h>
+#include <poll.h>
+#include <signal.h>
+#include <pthread.h>
+#include <sys/wait.h>
+#include <sys/prctl.h>
+#include "serv.h"
+#include "conn.h"
+#include "worker.h"
+
+//워커가 accept 프로세스에 보내는 부하 보고
+struct chan_load {
+        uint32_t got;           //지금까지 받은 연결 수
+        uint32_t live;          //지금 살아 있는 연결 수
+};
+
+//accept 프로세스가 보는 워커 상태
+struct worker {
+        pid_t pid;
+        int chan;
+        uint32_t sent;          //지금까지 보낸 연결 수
+        struct chan_load load;  //마지막 보고
+};
+
+static struct worker *workers;
+static int open_match = -1;     //상대를 기다리는 대결이 있는 워커
+static int match_fill;
+
+//워커 쪽 : 채널로 받은 연결 수
+static uint32_t chan_got;
+
+static int spawn(int i);
+static int pick_worker(void);
+static long worker_load(struct worker *w);
+
+//워커 n개를 fork한 뒤 이 프로세스는 accept만 함
+//워커 프로세스에서는 conf.chan을 채우고 반환해서 main이 이어서 서버를 띄움
+void run_acceptor(void) {
+        struct sockaddr_in clnt_adr;
+        socklen_t clnt_adr_sz;
+        struct pollfd *pfd;
+        struct chan_load load;
+        struct msghdr mh;
+        struct iovec iov;
+        struct cmsghdr *cm;
+        char ctl[CMSG_SPACE(sizeof(int))];
+        int serv_sock, unix_sock = -1, lsock, clnt_sock, i, j, n, reason, first;
+        ssize_t len;
+        long live, retry;
+
+        workers = calloc(conf.n_worker, sizeof(struct worker));
+        pfd = calloc(conf.n_worker + 2, sizeof(struct pollfd));
+        if(workers == NULL || pfd == NULL) {
+                error_handling("calloc() error");
+        }
+        for(i = 0 ; i < conf.n_worker ; i++) {
+                workers[i].chan = -1;
+        }
+        for(i = 0 ; i < conf.n_worker ; i++) {
+                if(spawn(i) == 0) {
+                        return;
+                }
+        }
+
+        serv_sock = open_listener(conf.port, 0);
+        if(set_nonblock(serv_sock) == -1) {
+                error_handling("fcntl() error");
+        }
+        //UNIX 소켓 연결도 같은 방법으로 워커에 넘김
+        if(conf.unix_path != NULL) {
+                unix_sock = open_unix_listener(conf.unix_path);
+                if(set_nonblock(unix_sock) == -1) {
+                        error_handling("fcntl() error");
+                }
+        }
+        fprintf(stderr, "acceptor : %d worker process(es), %s\n", conf.n_worker,
+                conf.worker_policy == WP_MATCH ? "match" : "least");
+
+        while(1) {
+                pfd[0].fd = serv_sock;
+                pfd[0].events = POLLIN;
+                for(i = 0 ; i < conf.n_worker ; i++) {
+                        pfd[i + 1].fd = workers[i].chan;
+                        pfd[i + 1].events = POLLIN;
+                }
+                pfd[conf.n_worker + 1].fd = unix_sock;
+                pfd[conf.n_worker + 1].events = POLLIN;
+                n = poll(pfd, conf.n_worker + 2, -1);
+
+                //SIGUSR1은 워커에게 전달, 각자 자기 통계를 출력
+                if(dump_req && __atomic_exchange_n(&dump_req, 0, __ATOMIC_RELAXED)) {
+                        for(i = 0 ; i < conf.n_worker ; i++) {
+                                kill(workers[i].pid, SIGUSR1);
+                        }
+                        admit_dump(stderr);
+                }
+                if(n <= 0) {
+                        continue;
+                }
+
+                for(i = 0 ; i < conf.n_worker ; i++) {
+                        if(!pfd[i + 1].revents) {
+                                continue;
+                        }
+                        len = recv(workers[i].chan, &load, sizeof(load), MSG_DONTWAIT);
+                        if(len == sizeof(load)) {
+                                workers[i].load = load;
+                                continue;
+                        }
+                        if(len == -1 && (errno == EINTR || errno == EAGAIN)) {
+                                continue;
+                        }
+                        //워커가 죽음, 그 워커의 플레이어만 끊기고 새 워커로 교체
+                        close(workers[i].chan);
+                        waitpid(workers[i].pid, NULL, 0);
+                        fprintf(stderr, "acceptor : worker %d (pid %d) exited, restarting\n", i, (int)workers[i].pid);
+                        if(open_match == i) {
+                                open_match = -1;
+                        }
+                        if(spawn(i) == 0) {
+                                close(serv_sock);
+                                if(unix_sock != -1) {
+                                        close(unix_sock);
+                                }
+                                free(pfd);
+                                return;
+                        }
+                }
+
+                if(!pfd[0].revents && !pfd[conf.n_worker + 1].revents) {
+                        continue;
+                }
+                lsock = pfd[0].revents ? serv_sock : unix_sock;
+                while(1) {
+                        clnt_adr_sz = sizeof(clnt_adr);
+                        //워커가 스레드 모드일 수 있으므로 논블로킹으로 받지 않음
+                        clnt_sock = accept4(lsock, (struct sockaddr*)&clnt_adr, &clnt_adr_sz, SOCK_CLOEXEC);
+                        if(clnt_sock == -1) {
+                                if(errno == EINTR || errno == ECONNABORTED) {
+                                        continue;
+                                }
+                                break;
+                        }
+                        if(lsock == unix_sock) {
+                                unix_peer(&clnt_adr);
+                        }
+
+                        //워커로 넘기기 전에 전체 연결 수로 판단
+                        for(live = 0, i = 0 ; i < conf.n_worker ; i++) {
+                                live += worker_load(&workers[i]);
+                        }
+                        if((retry = conn_admit(live, &reason)) > 0) {
+                                conn_reject(clnt_sock, &clnt_adr, reason, retry);
+                                continue;
+                        }
+
+                        i = pick_worker();
+                        //대결을 새로 여는 연결인지 (WP_MATCH가 아니면 항상 참)
+                        first = conf.worker_policy != WP_MATCH || (open_match == i && match_fill == 1);
+                        memset(&mh, 0, sizeof(mh));
+                        memset(ctl, 0, sizeof(ctl));
+                        iov.iov_base = &clnt_adr;
+                        iov.iov_len = sizeof(clnt_adr);
+                        mh.msg_iov = &iov;
+                        mh.msg_iovlen = 1;
+                        mh.msg_control = ctl;
+                        mh.msg_controllen = sizeof(ctl);
+                        cm = CMSG_FIRSTHDR(&mh);
+                        cm->cmsg_level = SOL_SOCKET;
+                        cm->cmsg_type = SCM_RIGHTS;
+                        cm->cmsg_len = CMSG_LEN(sizeof(int));
+                        memcpy(CMSG_DATA(cm), &clnt_sock, sizeof(int));
+                        //채널이 꽉 찬 워커 때문에 accept가 멈추지 않게 논블로킹, 안 되면 다음 워커로
+                        //대결에 합류하는 연결은 상대가 있는 워커로만 (다른 워커로 가면 대결이 안 만들어짐)
+                        for(j = 0, n = -1 ; n == -1 && j < (first ? conf.n_worker : 1) ; j++) {
+                                if(sendmsg(workers[(i + j) % conf.n_worker].chan, &mh, MSG_NOSIGNAL | MSG_DONTWAIT) != -1) {
+                                        n = (i + j) % conf.n_worker;
+                                }
+                        }
+                        if(n == -1) {
+                                //받아 줄 워커가 없음, 대결 자리는 되돌림 (합류 실패면 다음 연결이 그 자리를 채움)
+                                if(conf.worker_policy == WP_MATCH) {
+                                        if(first) {
+                                                open_match = -1;
+                                        } else {
+                                                open_match = i;
+                                                match_fill--;
+                                        }
+                                }
+                                conn_reject(clnt_sock, &clnt_adr, BUSY_FULL, ADMIT_RETRY_MS);
+                                continue;
+                        }
+                        workers[n].sent++;
+                        //새 대결이 다른 워커에서 열렸으면 상대도 그 워커로
+                        if(n != i && conf.worker_policy == WP_MATCH && open_match == i) {
+                                open_match = n;
+                        }
+                        //워커가 받은 뒤에는 이쪽 fd는 필요 없음
+                        close(clnt_sock);
+                }
+        }
+}
+
+//워커 i를 fork, 워커 프로세스면 0 반환
+static int spawn(int i) {
+        int sv[2], j;
+        pid_t pid;
+
+        if(socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1) {
+                error_handling("socketpair() error");
+        }
+        pid = fork();
+        if(pid == -1) {
+                error_handling("fork() error");
+        }
+        if(pid == 0) {
+                //accept 프로세스가 죽으면 같이 종료
+                prctl(PR_SET_PDEATHSIG, SIGTERM);
+                close(sv[0]);
+                for(j = 0 ; j < conf.n_worker ; j++) {
+                        if(workers[j].chan != -1 && j != i) {
+                                close(workers[j].chan);
+                        }
+                }
+                free(workers);
+                workers = NULL;
+                conf.chan = sv[1];
+                conf.worker_id = i;
+                return 0;
+        }
+        close(sv[1]);
+        memset(&workers[i], 0, sizeof(workers[i]));
+        workers[i].pid = pid;
+        workers[i].chan = sv[0];
+        return pid;
+}
+
+//아직 워커에 도착하지 않은 연결까지 포함한 부하
+static long worker_load(struct worker *w) {
+        return (long)w->load.live + (uint32_t)(w->sent - w->load.got);
+}
+
+static int pick_worker(void) {
+        int i, least = 0;
+
+        if(conf.worker_policy == WP_MATCH && open_match != -1) {
+                i = open_match;
+                if(++match_fill == MATCH_SIZE) {
+                        open_match = -1;
+                }
+                return i;
+        }
+        for(i = 1 ; i < conf.n_worker ; i++) {
+                if(worker_load(&workers[i]) < worker_load(&workers[least])) {
+                        least = i;
+                }
+        }
+        //새 대결은 가장 한가한 워커에서 시작
+        if(conf.worker_policy == WP_MATCH) {
+                open_match = least;
+                match_fill = 1;
+        }
+        return least;
+}
+
+//워커 쪽 : 연결 수가 바뀌면 accept 프로세스에 알림
+static void *load_loop(void *arg) {
+        struct timespec ts = { 0, LOAD_REPORT_MS * 1000000L };
+        struct chan_load load, last = { 0, 0 };
+
+        while(1) {
+                nanosleep(&ts, NULL);
+                load.got = __atomic_load_n(&chan_got, __ATOMIC_RELAXED);
+                load.live = conn_count();
+                if(load.got != last.got || load.live != last.live) {
+                        send(conf.chan, &load, sizeof(load), MSG_NOSIGNAL);
+                        last = load;
+                }
+        }
+        return NULL;
+}
+
+void worker_init(void) {
+        pthread_t t_id;
+
+        if(pthread_create(&t_id, NULL, load_loop, NULL) != 0) {
+                error_handling("pthread_create() error");
+        }
+        pthread_detach(t_id);
+}
+
+//채널에서 연결 1개를 받을 준비
+void chan_prep(struct chan_msg *m) {
+        memset(&m->mh, 0, sizeof(m->mh));
+        m->iov.iov_base = &m->peer;
+        m->iov.iov_len = sizeof(m->peer);
+        m->mh.msg_iov = &m->iov;
+        m->mh.msg_iovlen = 1;
+        m->mh.msg_control = m->ctl;
+        m->mh.msg_controllen = sizeof(m->ctl);
+}
+
+//받은 메시지에서 fd를 꺼냄, 없으면 -1
+int chan_take(struct chan_msg *m, int len) {
+        struct cmsghdr *cm;
+        int fd;
+
+        if(len != sizeof(m->peer)) {
+                return -1;
+        }
+        cm = CMSG_FIRSTHDR(&m->mh);
+        if(cm == NULL || cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) {
+                return -1;
+        }
+        memcpy(&fd, CMSG_DATA(cm), sizeof(int));
+        __atomic_add_fetch(&chan_got, 1, __ATOMIC_RELAXED);
+        return fd;
+}
+
+//accept 대신 호출, 받은 fd 또는 -1 (errno는 recvmsg 그대로)
+int chan_recv(int chan, struct sockaddr_in *peer) {
+        struct chan_msg m;
+        ssize_t len;
+        int fd;
+
+        chan_prep(&m);
+        len = recvmsg(chan, &m.mh, MSG_CMSG_CLOEXEC);
+        if(len <= 0) {
+                if(len == 0) {
+                        errno = ECONNRESET;
+                }
+                return -1;
+        }
+        fd = chan_take(&m, len);
+        if(fd == -1) {
+                errno = EPROTO;
+                return -1;
+        }
+        *peer = m.peer;
+        return fd;
+}
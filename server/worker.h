@@ -0,0 +1,31 @@
+#ifndef WORKER_H
+#define WORKER_H
+
+#include <sys/socket.h>
+#include <netinet/in.h>
+
+//멀티 프로세스 모드 : accept 전용 프로세스가 받은 fd를 워커 프로세스에 SCM_RIGHTS로 넘김
+//워커끼리는 아무것도 공유하지 않으므로 같은 대결의 플레이어는 같은 워커로 보냄
+
+//워커 선택 방식
+#define WP_MATCH 0              //대결 단위로 채움 (MATCH_SIZE명씩 같은 워커)
+#define WP_LEAST 1              //연결이 가장 적은 워커
+
+#define MATCH_SIZE 2            //대결 1개의 플레이어 수
+#define LOAD_REPORT_MS 100      //워커가 연결 수를 알려주는 주기
+
+//채널로 받는 연결 1개 (io_uring은 recvmsg를 직접 걸어야 해서 구조체로 둠)
+struct chan_msg {
+        struct msghdr mh;
+        struct iovec iov;
+        struct sockaddr_in peer;
+        char ctl[CMSG_SPACE(sizeof(int))];
+};
+
+void run_acceptor(void);
+void worker_init(void);
+void chan_prep(struct chan_msg *m);
+int chan_take(struct chan_msg *m, int len);
+int chan_recv(int chan, struct sockaddr_in *peer);
+
+#endif